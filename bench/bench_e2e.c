@@ -0,0 +1,390 @@
+/*
+ * End-to-end benchmark of the shell binary. Starts the shell under a pseudo
+ * terminal, like a user at the prompt, and with piped stdin, like a script,
+ * and replays these workloads through it:
+ *
+ *   - Thousands of trivial commands, both internal ones and /bin/true, timed
+ *     from sending the line to the next prompt
+ *   - A long pipeline moving a large file, and a large redirected copy
+ *   - Thousands of commands and background jobs from piped stdin
+ *
+ * The results are printed, and written as JSON to the report file so that
+ * runs of different versions of the shell can be compared.
+ *
+ * Usage: bench_e2e [flush binary] [report file]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRIVIAL_COMMANDS 2000
+#define PIPED_COMMANDS 2000
+#define BACKGROUND_JOBS 500
+#define PIPELINE_RUNS 3
+#define COPY_RUNS 3
+#define DATA_MEBIBYTES 64
+
+// Moves the data through every stage, half of them being exec'd commands
+#define PIPELINE "cat data | tr a-m n-z | cat | tr n-z a-m | cat | cat | cat | wc -c"
+#define PIPELINE_STAGES 8
+
+// A shell that does not show its prompt within this time is considered hung
+#define PROMPT_TIMEOUT_MS 60000
+
+// The prompt is the working directory followed by this
+#define PROMPT_SUFFIX ": "
+#define READ_SIZE 4096
+
+struct session_t {
+    pid_t pid;
+    int fd;
+    char prompt[PATH_MAX + sizeof(PROMPT_SUFFIX)];
+    size_t prompt_length;
+    // The last bytes of output, to find the prompt even when it is split
+    // across reads
+    char tail[PATH_MAX + sizeof(PROMPT_SUFFIX) + READ_SIZE];
+    size_t tail_length;
+};
+
+// Results of timing a single command repeatedly
+struct latency_t {
+    size_t count;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+    double per_second;
+};
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void fail(const char *message) {
+    fprintf(stderr, "bench_e2e: %s: %s\n", message, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static void write_all(int fd, const char *data, size_t length) {
+    ssize_t res;
+    for (size_t written = 0; written < length; written += res) {
+        res = write(fd, data + written, length - written);
+        if (res < 0) {
+            if (errno == EINTR) {
+                res = 0;
+                continue;
+            }
+
+            fail("write");
+        }
+    }
+}
+
+// Reads output until it ends with the prompt
+static void wait_prompt(struct session_t *session) {
+    struct pollfd fds = {.fd = session->fd, .events = POLLIN};
+    char buffer[READ_SIZE];
+    ssize_t res;
+
+    while (true) {
+        res = poll(&fds, 1, PROMPT_TIMEOUT_MS);
+        if (res == 0) {
+            errno = ETIMEDOUT;
+            fail("waiting for the prompt");
+        }
+
+        if (res < 0 || (res = read(session->fd, buffer, sizeof(buffer))) <= 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fail("reading from the shell");
+        }
+
+        // Keep only as much as the prompt is long
+        memcpy(session->tail + session->tail_length, buffer, res);
+        session->tail_length += res;
+        if (session->tail_length > session->prompt_length) {
+            memmove(session->tail, session->tail + session->tail_length - session->prompt_length,
+                    session->prompt_length);
+            session->tail_length = session->prompt_length;
+        }
+
+        if (session->tail_length == session->prompt_length &&
+            !memcmp(session->tail, session->prompt, session->prompt_length)) {
+            session->tail_length = 0;
+            return;
+        }
+    }
+}
+
+static void session_start(struct session_t *session, const char *flush) {
+    if (getcwd(session->prompt, PATH_MAX) == NULL) {
+        fail("getcwd");
+    }
+
+    strcat(session->prompt, PROMPT_SUFFIX);
+    session->prompt_length = strlen(session->prompt);
+    session->tail_length = 0;
+
+    session->pid = forkpty(&session->fd, NULL, NULL, NULL);
+    if (session->pid == -1) {
+        fail("forkpty");
+    }
+
+    if (session->pid == 0) {
+        execl(flush, flush, (char *)NULL);
+        _exit(127);
+    }
+
+    wait_prompt(session);
+}
+
+// Sends a command line and returns the time until the next prompt
+static long session_run(struct session_t *session, const char *line) {
+    long start = now_ns();
+    write_all(session->fd, line, strlen(line));
+    write_all(session->fd, "\n", 1);
+    wait_prompt(session);
+    return now_ns() - start;
+}
+
+// Exits the shell, returning its peak RSS in KiB
+static long session_finish(struct session_t *session) {
+    struct rusage usage;
+    int status;
+    char buffer[READ_SIZE];
+
+    write_all(session->fd, "exit\n", 5);
+    // Keep reading, so the shell never blocks on a full terminal
+    while (read(session->fd, buffer, sizeof(buffer)) > 0) {
+    }
+
+    if (wait4(session->pid, &status, 0, &usage) == -1) {
+        fail("wait4");
+    }
+
+    close(session->fd);
+    return usage.ru_maxrss;
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure_latency(struct session_t *session, const char *line, size_t count,
+                            struct latency_t *result) {
+    long *samples = malloc(count * sizeof(long)), total = 0;
+    if (samples == NULL) {
+        fail("malloc");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = session_run(session, line);
+        total += samples[i];
+    }
+
+    qsort(samples, count, sizeof(long), compare_long);
+    result->count = count;
+    result->p50_us = samples[(count - 1) * 50 / 100] / 1e3;
+    result->p90_us = samples[(count - 1) * 90 / 100] / 1e3;
+    result->p99_us = samples[(count - 1) * 99 / 100] / 1e3;
+    result->max_us = samples[count - 1] / 1e3;
+    result->per_second = count / (total / 1e9);
+    free(samples);
+}
+
+// Runs the command line a few times, returning the best throughput in MB/s
+static double measure_throughput(struct session_t *session, const char *line, int runs) {
+    long best = 0, elapsed;
+    for (int i = 0; i < runs; i++) {
+        elapsed = session_run(session, line);
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return DATA_MEBIBYTES * 1024.0 * 1024.0 / 1e6 / (best / 1e9);
+}
+
+// Runs a script through the shell with stdin as a pipe. Returns the time
+// taken, and the peak RSS of the shell in KiB through rss
+static long run_piped(const char *flush, const char *script, long *rss) {
+    struct rusage usage;
+    int fd[2], status, null;
+    if (pipe(fd)) {
+        fail("pipe");
+    }
+
+    long start = now_ns();
+    pid_t pid = fork();
+    if (pid == -1) {
+        fail("fork");
+    }
+
+    if (pid == 0) {
+        null = open("/dev/null", O_WRONLY);
+        dup2(fd[0], STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        close(null);
+        execl(flush, flush, (char *)NULL);
+        _exit(127);
+    }
+
+    close(fd[0]);
+    write_all(fd[1], script, strlen(script));
+    close(fd[1]);
+
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        fail("wait4");
+    }
+
+    *rss = usage.ru_maxrss;
+    return now_ns() - start;
+}
+
+// Builds a script of the same line repeated, followed by the given last line
+static char *repeat_line(const char *line, size_t count, const char *last) {
+    size_t length = strlen(line);
+    char *script = malloc((length + 1) * count + strlen(last) + 2);
+    if (script == NULL) {
+        fail("malloc");
+    }
+
+    char *end = script;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(end, line, length);
+        end += length;
+        *end++ = '\n';
+    }
+
+    sprintf(end, "%s\n", last);
+    return script;
+}
+
+static void write_data(const char *path) {
+    char block[65536];
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        fail("creating the data file");
+    }
+
+    // Text with lines, so every stage of a pipeline has real work to do
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = i % 64 == 63 ? '\n' : 'a' + (i * 7 + i / 64) % 26;
+    }
+
+    for (size_t i = 0; i < DATA_MEBIBYTES * 16; i++) {
+        write_all(fd, block, sizeof(block));
+    }
+
+    close(fd);
+}
+
+static void print_latency(FILE *report, const char *name, struct latency_t *latency, bool last) {
+    printf("  %-10s %6zu cmds  p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  max %8.1f us  %8.0f/s\n", name,
+           latency->count, latency->p50_us, latency->p90_us, latency->p99_us, latency->max_us,
+           latency->per_second);
+    fprintf(report,
+            "    \"%s\": {\"commands\": %zu, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, "
+            "\"max_us\": %.1f, \"per_second\": %.1f}%s\n",
+            name, latency->count, latency->p50_us, latency->p90_us, latency->p99_us, latency->max_us,
+            latency->per_second, last ? "" : ",");
+}
+
+int main(int argc, char **argv) {
+    char flush[PATH_MAX], directory[] = "/tmp/flush-e2e-XXXXXX";
+    const char *report_path = argc > 2 ? argv[2] : "build/bench_e2e.json";
+
+    // The shell is started from the scratch directory, so resolve it first
+    if (realpath(argc > 1 ? argv[1] : "./flush", flush) == NULL) {
+        fail("finding the shell");
+    }
+
+    FILE *report = fopen(report_path, "w");
+    if (report == NULL) {
+        fail("opening the report");
+    }
+
+    if (mkdtemp(directory) == NULL || chdir(directory)) {
+        fail("creating the scratch directory");
+    }
+
+    // Writing to a shell that has died should fail, not kill the benchmark
+    signal(SIGPIPE, SIG_IGN);
+    write_data("data");
+
+    struct session_t session;
+    struct latency_t builtin, spawn;
+    double pipeline_rate, copy_rate;
+    long pty_rss, piped_rss, rss, elapsed;
+
+    printf("%s, %d MiB of data\n", flush, DATA_MEBIBYTES);
+    printf("pty\n");
+    session_start(&session, flush);
+    measure_latency(&session, "true", TRIVIAL_COMMANDS, &builtin);
+    measure_latency(&session, "/bin/true", TRIVIAL_COMMANDS, &spawn);
+    pipeline_rate = measure_throughput(&session, PIPELINE, PIPELINE_RUNS);
+    copy_rate = measure_throughput(&session, "cat < data > copy", COPY_RUNS);
+    pty_rss = session_finish(&session);
+
+    fprintf(report, "{\n  \"flush\": \"%s\",\n  \"data_mib\": %d,\n  \"pty\": {\n", flush, DATA_MEBIBYTES);
+    print_latency(report, "builtin", &builtin, false);
+    print_latency(report, "spawn", &spawn, false);
+    printf("  %-10s %d stages %10.1f MB/s\n", "pipeline", PIPELINE_STAGES, pipeline_rate);
+    printf("  %-10s %17.1f MB/s\n", "copy", copy_rate);
+    printf("  %-10s %14ld KiB\n", "peak rss", pty_rss);
+    fprintf(report,
+            "    \"pipeline\": {\"stages\": %d, \"mb_per_s\": %.1f},\n"
+            "    \"copy\": {\"mb_per_s\": %.1f},\n"
+            "    \"peak_rss_kib\": %ld\n  },\n",
+            PIPELINE_STAGES, pipeline_rate, copy_rate, pty_rss);
+
+    printf("piped stdin\n");
+    char *script = repeat_line("/bin/true", PIPED_COMMANDS, "");
+    elapsed = run_piped(flush, script, &piped_rss);
+    free(script);
+    double spawn_rate = PIPED_COMMANDS / (elapsed / 1e9);
+
+    script = repeat_line("/bin/true &", BACKGROUND_JOBS, "wait");
+    elapsed = run_piped(flush, script, &rss);
+    free(script);
+    double background_rate = BACKGROUND_JOBS / (elapsed / 1e9);
+    piped_rss = rss > piped_rss ? rss : piped_rss;
+
+    printf("  %-10s %6d cmds %13.0f spawns/s\n", "spawn", PIPED_COMMANDS, spawn_rate);
+    printf("  %-10s %6d jobs %13.0f jobs/s\n", "background", BACKGROUND_JOBS, background_rate);
+    printf("  %-10s %14ld KiB\n", "peak rss", piped_rss);
+    fprintf(report,
+            "  \"piped\": {\n"
+            "    \"spawn\": {\"commands\": %d, \"per_second\": %.1f},\n"
+            "    \"background\": {\"jobs\": %d, \"per_second\": %.1f},\n"
+            "    \"peak_rss_kib\": %ld\n  }\n}\n",
+            PIPED_COMMANDS, spawn_rate, BACKGROUND_JOBS, background_rate, piped_rss);
+    fclose(report);
+
+    unlink("data");
+    unlink("copy");
+    chdir("/");
+    rmdir(directory);
+    printf("Report written to %s\n", report_path);
+    return EXIT_SUCCESS;
+}
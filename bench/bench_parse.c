@@ -0,0 +1,183 @@
+/*
+ * Benchmark for the front-end of the shell. Pushes corpora of realistic and
+ * adversarial command lines through tokens_read, commands_make_exec and
+ * commands_discard, and reports throughput and allocator usage.
+ *
+ * Usage: bench_parse [scalar|sse2|avx2]
+ *
+ * Must be linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+ * so that allocations made by the shell can be counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "commands.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// Every corpus is run for at least this long
+#define MIN_DURATION_NS 200000000L
+
+struct corpus_t {
+    const char *name;
+    char *line;
+    size_t length;
+};
+
+static size_t ALLOCATIONS = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    ALLOCATIONS++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    ALLOCATIONS++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    ALLOCATIONS++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+    __real_free(ptr);
+}
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Builds a line by repeating the given string count times, followed by suffix
+static char *repeat(const char *prefix, const char *part, size_t count, const char *suffix) {
+    size_t prefix_len = strlen(prefix), part_len = strlen(part), suffix_len = strlen(suffix);
+    char *line = malloc(prefix_len + part_len * count + suffix_len + 1);
+    if (line == NULL) {
+        fprintf(stderr, "Failed to allocate corpus\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *current = line;
+    memcpy(current, prefix, prefix_len);
+    current += prefix_len;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(current, part, part_len);
+        current += part_len;
+    }
+
+    memcpy(current, suffix, suffix_len + 1);
+    return line;
+}
+
+static void add_corpus(struct corpus_t *corpora, size_t *count, const char *name, char *line) {
+    corpora[*count].name = name;
+    corpora[*count].line = line;
+    corpora[*count].length = strlen(line);
+    (*count)++;
+}
+
+// Runs a single line through the front-end. Returns non-zero on failure
+static int parse_line(struct corpus_t *corpus) {
+    struct arena_t *arena = arena_create();
+    if (arena == NULL) {
+        return 1;
+    }
+
+    struct command_tokens_t tokens;
+    if (tokens_read(&tokens, corpus->line, corpus->length, arena)) {
+        arena_free(arena);
+        return 1;
+    }
+
+    struct command_execution_t *execution;
+    if (commands_make_exec(corpus->line, &tokens, &execution)) {
+        arena_free(arena);
+        return 1;
+    }
+
+    commands_discard(execution);
+    return 0;
+}
+
+static void run_corpus(struct corpus_t *corpus) {
+    // Warm up, and make sure the line is valid
+    if (parse_line(corpus)) {
+        fprintf(stderr, "Failed to parse corpus %s\n", corpus->name);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t lines = 0, batch = 1;
+    size_t allocations = ALLOCATIONS;
+    long start = now_ns(), elapsed;
+
+    do {
+        for (size_t i = 0; i < batch; i++) {
+            parse_line(corpus);
+        }
+
+        lines += batch;
+        batch *= 2;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_DURATION_NS);
+
+    allocations = ALLOCATIONS - allocations;
+
+    printf("%-16s %10zu %14.0f %10.3f %12.2f\n", corpus->name, corpus->length,
+           lines / (elapsed / 1e9), (double)elapsed / ((double)lines * corpus->length),
+           (double)allocations / lines);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        int implementation = !strcmp(argv[1], "scalar") ? SCAN_SCALAR
+                             : !strcmp(argv[1], "sse2") ? SCAN_SSE2
+                             : !strcmp(argv[1], "avx2") ? SCAN_AVX2
+                                                        : -1;
+        if (implementation == -1 || scan_select(implementation)) {
+            fprintf(stderr, "Unsupported scanner \"%s\"\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct corpus_t corpora[16];
+    size_t count = 0;
+
+    // Realistic lines
+    add_corpus(corpora, &count, "simple", strdup("ls -l"));
+    add_corpus(corpora, &count, "pipeline", strdup("cat /etc/passwd | grep root | sort -u | wc -l"));
+    add_corpus(corpora, &count, "redirect", strdup("sort -n < /dev/null >> /dev/null"));
+    add_corpus(corpora, &count, "quoted", strdup("git commit -m \"Fix the thing, again\" --author \"A B <a@b.c>\""));
+    add_corpus(corpora, &count, "background", strdup("rsync -a /srv/data/ backup:/srv/data/ > /dev/null &"));
+
+    // Generated and adversarial lines
+    add_corpus(corpora, &count, "many_args", repeat("echo", " /usr/local/share/some/generated/file.txt", 4096, ""));
+    add_corpus(corpora, &count, "long_path", repeat("ls /", "abcdefghijklmnopqrstuvwxyz012345/", 2048, ""));
+    add_corpus(corpora, &count, "escapes_64k", repeat("echo ", "\\ a", 64 * 1024 / 3, ""));
+    add_corpus(corpora, &count, "escapes_1m", repeat("echo ", "\\ a", 1024 * 1024 / 3, ""));
+    add_corpus(corpora, &count, "many_pipes", repeat("cat", " | cat", 1024, ""));
+    add_corpus(corpora, &count, "many_redirects", repeat("cat", " > /dev/null", 1024, ""));
+    add_corpus(corpora, &count, "dense_ops", repeat("a", "|b>/dev/null</dev/null>>/dev/null ", 1024, ""));
+
+    const char *scanners[] = {"scalar", "sse2", "avx2"};
+    printf("Scanner: %s\n", scanners[scan_selected()]);
+    printf("%-16s %10s %14s %10s %12s\n", "corpus", "bytes", "lines/sec", "ns/byte", "allocs/line");
+
+    for (size_t i = 0; i < count; i++) {
+        run_corpus(&corpora[i]);
+        free(corpora[i].line);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+/*
+ * Benchmark for the capacity of the pipes between parts of a command line.
+ * Pushes data through a 3-part pipeline, where the first part writes in
+ * bursts of 1 MiB, for a range of pipe sizes and reports the throughput.
+ *
+ * Usage: bench_pipe [MiB per run] [pipe size]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_shell.h"
+#include "commands.h"
+
+// Every size is measured this many times, the fastest run is reported
+#define RUNS 3
+#define DEFAULT_MEBIBYTES 2048
+
+// Returns the best throughput in MB/s
+static double measure(size_t pipe_size, size_t mebibytes) {
+    char line[256];
+    snprintf(line, sizeof(line),
+             "dd if=/dev/zero bs=1M count=%zu status=none | dd bs=1M status=none | wc -c", mebibytes);
+    commands_set_pipe_size(pipe_size);
+
+    long start, best = 0, elapsed;
+    for (int i = 0; i < RUNS; i++) {
+        start = bench_now_ns();
+        bench_run_command(line);
+        elapsed = bench_now_ns() - start;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return mebibytes * 1024.0 * 1024.0 / 1e6 / (best / 1e9);
+}
+
+int main(int argc, char **argv) {
+    size_t default_sizes[] = {65536, 131072, 262144, 524288, 1048576};
+    size_t mebibytes = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MEBIBYTES;
+    size_t count = argc > 2 ? (size_t)argc - 2 : sizeof(default_sizes) / sizeof(size_t);
+
+    FILE *report = bench_open_report();
+
+    fprintf(report, "%d parts, %zu MiB per run, pipe-max-size %zu\n", 3, mebibytes,
+            commands_get_pipe_max_size());
+    fprintf(report, "%12s %10s\n", "pipe size", "MB/s");
+
+    size_t size;
+    for (size_t i = 0; i < count; i++) {
+        if (argc > 2 && commands_parse_size(argv[i + 2], &size)) {
+            fprintf(stderr, "Invalid pipe size \"%s\"\n", argv[i + 2]);
+            return EXIT_FAILURE;
+        }
+
+        if (argc <= 2) {
+            size = default_sizes[i];
+        }
+
+        fprintf(report, "%12zu %10.0f\n", size, measure(size, mebibytes));
+        fflush(report);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#include "bench_shell.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "commands.h"
+#include "tokenizer.h"
+
+long bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void bench_run_command(char *line) {
+    struct arena_t *arena = arena_create();
+    struct command_tokens_t tokens;
+    struct command_execution_t *execution;
+    if (arena == NULL || tokens_read(&tokens, line, strlen(line), arena) ||
+        commands_make_exec(line, &tokens, &execution)) {
+        fprintf(stderr, "Failed to prepare [%s]\n", line);
+        exit(EXIT_FAILURE);
+    }
+
+    commands_execute(execution);
+}
+
+FILE *bench_open_report() {
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_WRONLY);
+    if (report == NULL || null == -1) {
+        fprintf(stderr, "Failed to set up output\n");
+        exit(EXIT_FAILURE);
+    }
+
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    return report;
+}
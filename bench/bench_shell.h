@@ -0,0 +1,35 @@
+#ifndef __BENCH_SHELL_H__
+#define __BENCH_SHELL_H__
+
+#include <stdio.h>
+
+/*
+ * Helpers for the benchmarks that run command lines through the shell's own
+ * commands_execute, in the benchmark process.
+ */
+
+/**
+ * @brief Monotonic time
+ *
+ * @return long - Nanoseconds since an arbitrary point
+ */
+long bench_now_ns();
+
+/**
+ * @brief Parses and runs a command line, exits the process if it cannot be
+ * prepared
+ *
+ * @param line The command line
+ */
+void bench_run_command(char *line);
+
+/**
+ * @brief The shell reports exit statuses on stdout, so redirect stdout to
+ * /dev/null and return a stream on the original stdout for the results.
+ * Exits the process on failure.
+ *
+ * @return FILE* - The stream for the results
+ */
+FILE *bench_open_report();
+
+#endif
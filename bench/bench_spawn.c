@@ -0,0 +1,62 @@
+/*
+ * Benchmark comparing the process launch backends of the shell. For a range
+ * of shell memory sizes, runs "/bin/true" through commands_execute repeatedly
+ * with both fork() + exec and posix_spawnp(), and reports the average time
+ * per command.
+ *
+ * Usage: bench_spawn [rss in MiB]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_shell.h"
+#include "commands.h"
+
+#define ITERATIONS 500
+
+static double measure(int backend) {
+    commands_set_spawn_backend(backend);
+
+    long start = bench_now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        bench_run_command("/bin/true");
+    }
+
+    return (bench_now_ns() - start) / 1e3 / ITERATIONS;
+}
+
+int main(int argc, char **argv) {
+    size_t default_sizes[] = {0, 128, 512};
+    size_t count = argc > 1 ? (size_t)argc - 1 : sizeof(default_sizes) / sizeof(size_t);
+
+    FILE *report = bench_open_report();
+
+    fprintf(report, "%10s %14s %14s\n", "rss (MiB)", "fork (us/cmd)", "spawn (us/cmd)");
+
+    char *ballast = NULL;
+    size_t size;
+    double fork_time, spawn_time;
+    for (size_t i = 0; i < count; i++) {
+        size = argc > 1 ? strtoul(argv[i + 1], NULL, 10) : default_sizes[i];
+
+        // Touch every page so it is actually part of the resident set
+        free(ballast);
+        ballast = malloc(size * 1024 * 1024 + 1);
+        if (ballast == NULL) {
+            fprintf(stderr, "Failed to allocate %zu MiB\n", size);
+            return EXIT_FAILURE;
+        }
+
+        memset(ballast, 1, size * 1024 * 1024 + 1);
+
+        fork_time = measure(COMMANDS_SPAWN_FORK);
+        spawn_time = measure(COMMANDS_SPAWN_POSIX);
+        fprintf(report, "%10zu %14.1f %14.1f\n", size, fork_time, spawn_time);
+        fflush(report);
+    }
+
+    free(ballast);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/*
+ * Fuzzing entry point for tokens_read. Every input is tokenized by the
+ * reference tokenizer and by tokens_read with each scanner implementation
+ * supported by the CPU, and the process aborts if any of them disagree.
+ *
+ * Built with -DFLUSH_LIBFUZZER this is a libFuzzer target. Otherwise a main
+ * function is provided that runs every file given as argument (or stdin if
+ * there are none) once, which works with AFL and for replaying crashes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "reference_tokenizer.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// The reference tokenizer is quadratic on some inputs, so keep inputs small
+#define FUZZ_MAX_INPUT 65536
+
+static void compare(struct reference_tokens_t *expected, struct command_tokens_t *actual, int implementation) {
+    int equal = expected->token_count == actual->token_count;
+    for (size_t i = 0; equal && i < expected->token_count; i++) {
+        equal = !strcmp(expected->tokens[i], actual->tokens[i]);
+    }
+
+    if (equal) {
+        return;
+    }
+
+    fprintf(stderr, "Token mismatch with scanner %d\n", implementation);
+    for (size_t i = 0; i < expected->token_count; i++) {
+        fprintf(stderr, " expected[%zu] = \"%s\"\n", i, expected->tokens[i]);
+    }
+
+    for (size_t i = 0; i < actual->token_count; i++) {
+        fprintf(stderr, " actual[%zu] = \"%s\"\n", i, actual->tokens[i]);
+    }
+
+    abort();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size > FUZZ_MAX_INPUT) {
+        return 0;
+    }
+
+    char *input = malloc(size + 1);
+    if (input == NULL) {
+        return 0;
+    }
+
+    memcpy(input, data, size);
+    input[size] = '\0';
+
+    // The reference tokenizer predates here-documents, and splits "<<" and
+    // "<<<" into separate "<" tokens
+    if (strstr(input, "<<") != NULL) {
+        free(input);
+        return 0;
+    }
+
+    struct reference_tokens_t expected;
+    if (reference_tokens_read(&expected, input, size)) {
+        free(input);
+        return 0;
+    }
+
+    int previous = scan_selected();
+    struct command_tokens_t actual;
+    struct arena_t *arena;
+    for (int implementation = SCAN_SCALAR; implementation <= SCAN_AVX2; implementation++) {
+        if (scan_select(implementation)) {
+            continue;  // Not supported on this CPU
+        }
+
+        arena = arena_create();
+        if (arena == NULL) {
+            break;
+        }
+
+        if (tokens_read(&actual, input, size, arena)) {
+            fprintf(stderr, "tokens_read failed with scanner %d\n", implementation);
+            abort();
+        }
+
+        compare(&expected, &actual, implementation);
+        arena_free(arena);
+    }
+
+    scan_select(previous);
+    reference_tokens_finish(&expected);
+    free(input);
+    return 0;
+}
+
+#ifndef FLUSH_LIBFUZZER
+static int run_file(FILE *file) {
+    static uint8_t data[FUZZ_MAX_INPUT];
+    size_t size = fread(data, 1, sizeof(data), file);
+    return LLVMFuzzerTestOneInput(data, size);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return run_file(stdin);
+    }
+
+    FILE *file;
+    for (int i = 1; i < argc; i++) {
+        file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "Unable to open \"%s\"\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+
+        run_file(file);
+        fclose(file);
+    }
+
+    return EXIT_SUCCESS;
+}
+#endif
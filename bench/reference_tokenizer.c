@@ -0,0 +1,160 @@
+#include "reference_tokenizer.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IS_WHITESPACE(x) (x == 0x20 || x == 0x09)
+#define IS_IO_REDIRECT(x) (x == '>' || x == '<')
+#define IS_PIPE_SPLIT(x) (x == '|')
+
+static int reference_add_token(struct reference_tokens_t *tokens, char *ch, size_t len) {
+    if (len == 0) {
+        return 0;  // Nothing to add
+    }
+
+    char **reallocated = realloc(tokens->tokens, sizeof(char *) * (tokens->token_count + 1));
+    if (reallocated == NULL) {
+        return 1;
+    }
+
+    tokens->tokens = reallocated;
+    tokens->token_count++;
+    char *dest = malloc(len + 1);
+    if (dest == NULL) {
+        return 2;
+    }
+
+    tokens->tokens[tokens->token_count - 1] = dest;
+    memcpy(dest, ch, len);
+    *(dest + len) = '\0';
+
+    return 0;
+}
+
+int reference_tokens_read(struct reference_tokens_t *tokens, char *input, size_t maxlen) {
+    // Duplicate the string to avoid modifying it
+    input = strdup(input);
+    if (input == NULL) {
+        return 1;
+    }
+
+    size_t len = strlen(input);
+    if (len > maxlen) {
+        len = maxlen;
+    }
+
+    tokens->token_count = 0;
+    tokens->tokens = NULL;
+
+    bool escape = false;
+    bool quotation = false;
+    size_t start_index = 0;
+
+    /*
+    This method also supports quotation marks and escape character for spaces
+    because it was fun to implement.
+    */
+
+    char ch;
+    for (size_t i = 0; i < len; i++) {
+        ch = input[i];
+        if (ch == '\\') {
+            escape = true;
+            memmove(&input[i], &input[i + 1], len - i - 1);
+            ch = input[i];
+            len--;
+        }
+
+        if (IS_WHITESPACE(ch)) {
+            // We are within quotation marks
+            if (quotation) {
+                continue;
+            }
+
+            if (escape) {
+                escape = false;
+                continue;
+            }
+
+            if (reference_add_token(tokens, input + start_index, i - start_index)) {
+                reference_tokens_finish(tokens);
+                free(input);
+                return 1;
+            }
+
+            start_index = i + 1;
+            continue;
+        }
+
+        // Special consideration to split even if there is no whitespace
+        if (IS_IO_REDIRECT(ch) || IS_PIPE_SPLIT(ch)) {
+            if (quotation) {
+                continue;
+            }
+
+            // Complete previous token
+            if (start_index != i) {
+                if (reference_add_token(tokens, input + start_index, i - start_index)) {
+                    reference_tokens_finish(tokens);
+                    free(input);
+                    return 1;
+                }
+
+                start_index = i;
+            }
+
+            // Allow ">>"
+            if ((len - i) > 1 && input[i + 1] == '>') {
+                i++;
+            }
+
+            if (reference_add_token(tokens, input + start_index, i - start_index + 1)) {
+                reference_tokens_finish(tokens);
+                free(input);
+                return 1;
+            }
+
+            start_index = i + 1;
+        }
+
+        if (ch == '"') {
+            quotation = !quotation;
+
+            if (quotation) {
+                start_index = i + 1;
+            } else {
+                if (reference_add_token(tokens, input + start_index, i - start_index)) {
+                    reference_tokens_finish(tokens);
+                    free(input);
+                    return 1;
+                }
+
+                start_index = i + 1;
+            }
+        }
+    }
+
+    if ((len - start_index) > 0 && reference_add_token(tokens, input + start_index, len - start_index)) {
+        for (size_t i = 0; i < tokens->token_count; i++) {
+            free(tokens->tokens[i]);
+        }
+
+        free(input);
+        free(tokens->tokens);
+        return 1;
+    }
+
+    free(input);
+    return 0;
+}
+
+void reference_tokens_finish(struct reference_tokens_t *token) {
+    for (size_t i = 0; i < token->token_count; i++) {
+        free(token->tokens[i]);
+    }
+
+    token->token_count = 0;
+    free(token->tokens);
+}
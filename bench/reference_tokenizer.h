@@ -0,0 +1,34 @@
+#ifndef __REFERENCE_TOKENIZER_H__
+#define __REFERENCE_TOKENIZER_H__
+
+#include <stddef.h>
+
+/*
+ * The original, straightforward implementation of tokens_read. It is kept
+ * as an oracle, so that the optimized tokenizer can be checked for giving
+ * identical output.
+ */
+
+struct reference_tokens_t {
+    size_t token_count;
+    char **tokens;
+};
+
+/**
+ * @brief Parses the given input the same way tokens_read does
+ *
+ * @param tokens The output location for parsed result
+ * @param input Input string
+ * @param maxlen The maximum parsed length
+ * @return int - 0 if success, non-zero otherwise
+ */
+int reference_tokens_read(struct reference_tokens_t *tokens, char *input, size_t maxlen);
+
+/**
+ * @brief Frees any allocated memory
+ *
+ * @param tokens The tokens
+ */
+void reference_tokens_finish(struct reference_tokens_t *tokens);
+
+#endif
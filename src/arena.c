@@ -0,0 +1,126 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+// All allocations are aligned to this
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+#define ALIGN_UP(x) (((x) + (ARENA_ALIGNMENT - 1)) & ~(ARENA_ALIGNMENT - 1))
+
+struct arena_chunk_t {
+    struct arena_chunk_t *prev;
+    size_t capacity;
+    size_t used;
+    alignas(max_align_t) char data[];
+};
+
+// The first chunk is allocated in the same block as the arena itself, so
+// that a command line that fits in it only costs a single malloc call
+struct arena_block_t {
+    struct arena_t arena;
+    struct arena_chunk_t chunk;
+};
+
+struct arena_t *arena_create() {
+    struct arena_block_t *block = malloc(sizeof(struct arena_block_t) + ARENA_INITIAL_SIZE);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->chunk.prev = NULL;
+    block->chunk.capacity = ARENA_INITIAL_SIZE;
+    block->chunk.used = 0;
+    block->arena.current = &block->chunk;
+    block->arena.last = NULL;
+    return &block->arena;
+}
+
+void *arena_alloc(struct arena_t *arena, size_t size) {
+    struct arena_chunk_t *chunk = arena->current;
+    size_t offset = ALIGN_UP(chunk->used);
+
+    if (offset > chunk->capacity || size > chunk->capacity - offset) {
+        // Grow geometrically, but make sure the requested size fits
+        size_t capacity = chunk->capacity * 2;
+        if (capacity < size) {
+            capacity = ALIGN_UP(size);
+        }
+
+        struct arena_chunk_t *next = malloc(sizeof(struct arena_chunk_t) + capacity);
+        if (next == NULL) {
+            return NULL;
+        }
+
+        next->prev = chunk;
+        next->capacity = capacity;
+        next->used = 0;
+        arena->current = next;
+        chunk = next;
+        offset = 0;
+    }
+
+    chunk->used = offset + size;
+    arena->last = chunk->data + offset;
+    return arena->last;
+}
+
+void *arena_realloc(struct arena_t *arena, void *ptr, size_t old_size, size_t size) {
+    if (ptr != NULL && ptr == arena->last) {
+        struct arena_chunk_t *chunk = arena->current;
+        size_t offset = (char *)ptr - chunk->data;
+        if (size <= chunk->capacity - offset) {
+            chunk->used = offset + size;
+            return ptr;
+        }
+    }
+
+    void *allocated = arena_alloc(arena, size);
+    if (allocated == NULL) {
+        return NULL;
+    }
+
+    if (ptr != NULL) {
+        memcpy(allocated, ptr, old_size < size ? old_size : size);
+    }
+
+    return allocated;
+}
+
+char *arena_strndup(struct arena_t *arena, const char *str, size_t len) {
+    char *dest = arena_alloc(arena, len + 1);
+    if (dest == NULL) {
+        return NULL;
+    }
+
+    memcpy(dest, str, len);
+    dest[len] = '\0';
+    return dest;
+}
+
+void arena_reset(struct arena_t *arena) {
+    struct arena_block_t *block = (struct arena_block_t *)arena;
+    struct arena_chunk_t *chunk = arena->current;
+    struct arena_chunk_t *prev;
+
+    // Free everything but the chunk that lives inside the arena block
+    while (chunk != &block->chunk) {
+        prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+
+    block->chunk.used = 0;
+    arena->current = &block->chunk;
+    arena->last = NULL;
+}
+
+void arena_free(struct arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_reset(arena);
+    free(arena);
+}
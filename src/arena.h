@@ -0,0 +1,85 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/*
+ * Simple bump allocator. Memory is handed out from large chunks, and is
+ * released all at once when the arena is reset or free'd. Used for all
+ * allocations that share the lifetime of a single command line.
+ */
+
+// Size of the first chunk, which is allocated together with the arena itself
+#define ARENA_INITIAL_SIZE 4096
+
+// Internal chunk structure
+struct arena_chunk_t;
+
+struct arena_t {
+    /**
+     * The chunk allocations are currently made from. Older chunks are
+     * linked from this one.
+     */
+    struct arena_chunk_t *current;
+    /**
+     * The most recent allocation, which can be resized in place
+     */
+    void *last;
+};
+
+/**
+ * @brief Create a new arena
+ *
+ * @return struct arena_t* - The arena, NULL if allocation failed
+ */
+struct arena_t *arena_create();
+
+/**
+ * @brief Allocate memory from the arena. The memory is aligned for any type.
+ *
+ * @param arena The arena
+ * @param size The amount of bytes
+ * @return void* - The allocated memory, NULL if allocation failed
+ */
+void *arena_alloc(struct arena_t *arena, size_t size);
+
+/**
+ * @brief Resize an allocation. If ptr is the most recent allocation and there
+ * is space left in the chunk, this happens in place. Otherwise new memory is
+ * allocated and the data is copied. The old memory is not reclaimed until the
+ * arena is reset.
+ *
+ * @param arena The arena
+ * @param ptr The previous allocation, may be NULL
+ * @param old_size The size of the previous allocation
+ * @param size The new size
+ * @return void* - The resized memory, NULL if allocation failed
+ */
+void *arena_realloc(struct arena_t *arena, void *ptr, size_t old_size, size_t size);
+
+/**
+ * @brief Copy the given string into the arena
+ *
+ * @param arena The arena
+ * @param str The string
+ * @param len The amount of characters to copy. A NUL terminator is added.
+ * @return char* - The copy, NULL if allocation failed
+ */
+char *arena_strndup(struct arena_t *arena, const char *str, size_t len);
+
+/**
+ * @brief Release all allocations made from the arena, but keep the memory
+ * of the first chunk around for reuse
+ *
+ * @param arena The arena
+ */
+void arena_reset(struct arena_t *arena);
+
+/**
+ * @brief Free the arena and all allocations made from it
+ *
+ * @param arena The arena
+ */
+void arena_free(struct arena_t *arena);
+
+#endif
@@ -0,0 +1,331 @@
+#include "builtins.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cwd.h"
+#include "history.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "pathcache.h"
+#include "plancache.h"
+#include "stats.h"
+#include "trace.h"
+
+// Function for handling the cd command
+static int change_wkd(struct command_part_t *part) {
+    // check if argv has 2 or more args
+    if (part->argc < 2) {
+        printf("Please provide a target directory to change to\n");
+        return EXIT_FAILURE;
+    }
+
+    // Check if passed argument is a legal dir
+    if (chdir(part->argv[1]) == -1) {
+        printf("Couldn't find target directory \"%s\"\n", part->argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if (cwd_refresh()) {
+        printf("Unable to retrieve current working directory!\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Prints the hit/miss counters of the cache of parsed command lines, or
+// clears it with "cache -c"
+static int builtin_cache(struct command_part_t *part) {
+    if (part->argc > 1 && !strcmp(part->argv[1], "-c")) {
+        plancache_clear();
+        return EXIT_SUCCESS;
+    }
+
+    struct plancache_stats_t stats;
+    plancache_stats(&stats);
+    printf("Parse cache: %zu hits, %zu misses, %zu evictions, %zu/%d entries\n", stats.hits,
+           stats.misses, stats.evictions, stats.entries, PLANCACHE_MAX_ENTRIES);
+    return EXIT_SUCCESS;
+}
+
+static int builtin_echo(struct command_part_t *part) {
+    bool newline = true;
+    int i = 1;
+    if (part->argc > 1 && !strcmp(part->argv[1], "-n")) {
+        newline = false;
+        i++;
+    }
+
+    for (; i < part->argc; i++) {
+        fputs(part->argv[i], stdout);
+        if (i + 1 < part->argc) {
+            putchar(' ');
+        }
+    }
+
+    if (newline) {
+        putchar('\n');
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int builtin_exit(struct command_part_t *part) {
+    // Without an argument, like in sh, the shell exits with the status of
+    // the last command line
+    int status = part->argc > 1 ? atoi(part->argv[1]) : commands_last_status();
+    fflush(stdout);
+    exit(status);
+}
+
+static int builtin_false(struct command_part_t *part) {
+    (void)part;
+    return EXIT_FAILURE;
+}
+
+// Lists the cache of resolved executables, or flushes it with "hash -r"
+static int builtin_hash(struct command_part_t *part) {
+    if (part->argc > 1 && !strcmp(part->argv[1], "-r")) {
+        pathcache_clear();
+        return EXIT_SUCCESS;
+    }
+
+    pathcache_print(stdout);
+    return EXIT_SUCCESS;
+}
+
+// Prints the command history, or only the last N entries with "history N".
+// "history -s term" prints the distinct command lines containing the term,
+// and "history -p term" those starting with it
+static int builtin_history(struct command_part_t *part) {
+    if (!history_enabled()) {
+        fprintf(stderr, "History is not being recorded\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t matches;
+    if (part->argc == 3 && (!strcmp(part->argv[1], "-s") || !strcmp(part->argv[1], "-p"))) {
+        if (history_search(stdout, part->argv[2], part->argv[1][1] == 'p', &matches)) {
+            fprintf(stderr, "Unable to read the history file\n");
+            return EXIT_FAILURE;
+        }
+
+        return matches > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    char *end = NULL;
+    size_t count = part->argc == 2 ? strtoul(part->argv[1], &end, 10) : 0;
+    if (part->argc > 2 || (end != NULL && (end == part->argv[1] || *end != '\0'))) {
+        fprintf(stderr, "Usage: history [count | -s term | -p prefix]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (history_print(stdout, count)) {
+        fprintf(stderr, "Unable to read the history file\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Indexes new history entries in the shell, so that a forked "history -s"
+// does not index the whole file in its own copy. Errors are reported by the
+// forked history itself
+static void prepare_history() {
+    history_refresh();
+}
+
+// Prints the state of a single part of a background job
+static void print_part(struct command_part_t *part) {
+    if (part->running) {
+        printf("     PID %-8d %-16s running\n", part->pid, part->executable);
+    } else if (WIFEXITED(part->status)) {
+        printf("     PID %-8d %-16s exited %d\n", part->pid, part->executable, WEXITSTATUS(part->status));
+    } else {
+        printf("     PID %-8d %-16s killed by signal %d\n", part->pid, part->executable, WTERMSIG(part->status));
+    }
+}
+
+// Prints all running background processes
+static int builtin_jobs(struct command_part_t *part) {
+    (void)part;
+    if (jobs_count() == 0) {
+        printf("There are no jobs running in the background\n");
+        return EXIT_SUCCESS;
+    }
+
+    printf("Jobs running in background (%zu):\n", jobs_count());
+
+    struct job_t *job;
+    struct command_execution_t *exec;
+    for (size_t id = 1; id <= jobs_last_id(); id++) {
+        job = jobs_get(id);
+        if (job == NULL) {
+            continue;
+        }
+
+        exec = job->execution;
+        printf(" [%zu] PID %d - \"%s\"\n", job->id, exec->parts[exec->part_count - 1].pid, exec->command_line);
+
+        // Show how far along every part of a pipeline is
+        if (exec->part_count > 1) {
+            for (size_t i = 0; i < exec->part_count; i++) {
+                print_part(&exec->parts[i]);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Prints or sets the capacity of the pipes between parts of a command line,
+// e.g. "pipesize 1M". "pipesize default" goes back to the kernel default
+static int builtin_pipesize(struct command_part_t *part) {
+    size_t size;
+
+    if (part->argc == 1) {
+        size = commands_get_pipe_size();
+        if (size == 0) {
+            printf("default (maximum %zu)\n", commands_get_pipe_max_size());
+        } else {
+            printf("%zu (maximum %zu)\n", size, commands_get_pipe_max_size());
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (!strcmp(part->argv[1], "default")) {
+        commands_set_pipe_size(0);
+        return EXIT_SUCCESS;
+    }
+
+    if (commands_parse_size(part->argv[1], &size)) {
+        fprintf(stderr, "Usage: pipesize [bytes[K|M] | default]\n");
+        return EXIT_FAILURE;
+    }
+
+    commands_set_pipe_size(size);
+    return EXIT_SUCCESS;
+}
+
+static int builtin_pwd(struct command_part_t *part) {
+    (void)part;
+    if (cwd_get() == NULL && cwd_refresh()) {
+        fprintf(stderr, "Unable to retrieve current working directory!\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%s\n", cwd_get());
+    return EXIT_SUCCESS;
+}
+
+// Supports "set -o pipefail" and "set +o pipefail". Without arguments the
+// current options are printed
+static int builtin_set(struct command_part_t *part) {
+    if (part->argc == 1) {
+        printf("pipefail\t%s\n", commands_get_pipefail() ? "on" : "off");
+        return EXIT_SUCCESS;
+    }
+
+    if (part->argc != 3 || strcmp(part->argv[2], "pipefail") ||
+        (strcmp(part->argv[1], "-o") && strcmp(part->argv[1], "+o"))) {
+        fprintf(stderr, "Usage: set [-o pipefail | +o pipefail]\n");
+        return EXIT_FAILURE;
+    }
+
+    commands_set_pipefail(part->argv[1][0] == '-');
+    return EXIT_SUCCESS;
+}
+
+// Starts recording a trace with "trace FILE", stops with "trace off" and
+// shows where the trace is written without arguments
+static int builtin_trace(struct command_part_t *part) {
+    if (part->argc == 1) {
+        if (trace_enabled) {
+            printf("Tracing to %s\n", trace_path());
+        } else {
+            printf("Tracing is off\n");
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (part->argc != 2) {
+        fprintf(stderr, "Usage: trace [file | off]\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!strcmp(part->argv[1], "off")) {
+        trace_stop();
+        return EXIT_SUCCESS;
+    }
+
+    if (trace_start(part->argv[1])) {
+        fprintf(stderr, "Unable to open trace file \"%s\"\n", part->argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Prints the counters and latency histograms of the shell, "stats -v" with
+// every bucket of the histograms. "stats --reset" clears them
+static int builtin_stats(struct command_part_t *part) {
+    if (part->argc == 1 || (part->argc == 2 && !strcmp(part->argv[1], "-v"))) {
+        stats_print(stdout, part->argc == 2);
+        return EXIT_SUCCESS;
+    }
+
+    if (part->argc == 2 && !strcmp(part->argv[1], "--reset")) {
+        stats_reset();
+        return EXIT_SUCCESS;
+    }
+
+    fprintf(stderr, "Usage: stats [-v | --reset]\n");
+    return EXIT_FAILURE;
+}
+
+static int builtin_true(struct command_part_t *part) {
+    (void)part;
+    return EXIT_SUCCESS;
+}
+
+// Waits for all background jobs to complete
+static int builtin_wait(struct command_part_t *part) {
+    (void)part;
+    commands_wait_running();
+    return EXIT_SUCCESS;
+}
+
+// Must be kept sorted by name, since it is searched with bsearch
+static const struct builtin_t BUILTINS[] = {
+    {.name = "cache", .run = builtin_cache, .in_process = true},
+    {.name = "cd", .run = change_wkd, .in_process = true},
+    {.name = "echo", .run = builtin_echo, .in_process = false},
+    {.name = "exit", .run = builtin_exit, .in_process = true},
+    {.name = "false", .run = builtin_false, .in_process = false},
+    {.name = "hash", .run = builtin_hash, .in_process = true},
+    {.name = "history", .run = builtin_history, .in_process = false, .prepare = prepare_history},
+    {.name = "jobs", .run = builtin_jobs, .in_process = false},
+    {.name = "parallel", .run = parallel_run, .in_process = true},
+    {.name = "pipesize", .run = builtin_pipesize, .in_process = true},
+    {.name = "pwd", .run = builtin_pwd, .in_process = false},
+    {.name = "set", .run = builtin_set, .in_process = true},
+    {.name = "stats", .run = builtin_stats, .in_process = true},
+    {.name = "trace", .run = builtin_trace, .in_process = true},
+    {.name = "true", .run = builtin_true, .in_process = false},
+    {.name = "wait", .run = builtin_wait, .in_process = true},
+};
+
+static int compare_builtin(const void *name, const void *builtin) {
+    return strcmp(name, ((const struct builtin_t *)builtin)->name);
+}
+
+const struct builtin_t *builtins_find(const char *name) {
+    return bsearch(name, BUILTINS, sizeof(BUILTINS) / sizeof(BUILTINS[0]), sizeof(struct builtin_t),
+                   compare_builtin);
+}
@@ -0,0 +1,53 @@
+#ifndef __BUILTINS_H__
+#define __BUILTINS_H__
+
+#include <stdbool.h>
+
+#include "commands.h"
+
+/*
+ * Registry of internal commands. Builtins run directly in the shell when they
+ * are not part of a pipeline, with any I/O redirection applied temporarily.
+ * In a pipeline they run in a forked copy of the shell, so that they can be
+ * used in pipes (e.g. "jobs | grep rsync"), except for builtins that act on
+ * the shell itself. Those still run in the shell as the last part of a
+ * pipeline, like bash with "lastpipe", e.g. "ls | parallel gzip".
+ */
+
+/**
+ * @brief An internal command
+ */
+struct builtin_t {
+    /**
+     * Name used to invoke the command
+     */
+    const char *name;
+    /**
+     * @brief Runs the command.
+     *
+     * @param part The part invoking the command, with argv[0] being the name
+     * @return int - The exit status of the command
+     */
+    int (*run)(struct command_part_t *part);
+    /**
+     * If the command acts on the shell process itself, e.g. "cd" or "wait",
+     * and should run in it even as the last part of a pipeline. Other
+     * commands are forked in any pipeline
+     */
+    bool in_process;
+    /**
+     * Runs in the shell before the command is forked, e.g. to fill a cache
+     * that the forked copy then inherits. NULL if there is nothing to do
+     */
+    void (*prepare)();
+};
+
+/**
+ * @brief Find the builtin with the given name
+ *
+ * @param name The name of the command
+ * @return const struct builtin_t* - The builtin, NULL if there is none
+ */
+const struct builtin_t *builtins_find(const char *name);
+
+#endif
@@ -1,248 +1,746 @@
+#define _GNU_SOURCE
 #include "commands.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-#include "llist.h"
+#include "builtins.h"
+#include "jobs.h"
+#include "mover.h"
+#include "policy.h"
+#include "stats.h"
+#include "trace.h"
+#include "pathcache.h"
+
+extern char **environ;
+
+static int SPAWN_BACKEND = COMMANDS_SPAWN_POSIX;
+
+// Readable whenever a child has changed state, see commands_watch_children()
+static int CHILD_FD = -1;
+// Signal mask the shell was started with, restored in every child
+static sigset_t CHILD_SIGMASK;
+
+static bool PIPEFAIL = false;
+// Capacity of the pipes between parts. 0 keeps the kernel default
+static size_t PIPE_SIZE = 0;
+// Largest capacity an unprivileged process may set, 0 until it is read
+static size_t PIPE_MAX_SIZE = 0;
+// If pure copies are done by a forked mover instead of exec'ing cat
+static bool COPY_FASTPATH = true;
+// The foreground command line being executed, or NULL
+static struct command_execution_t *FOREGROUND = NULL;
+// Exit status of the last foreground command line, see commands_last_status()
+static int LAST_STATUS = EXIT_SUCCESS;
+
+// Initial amount of parts allocated for a command line. Grows geometrically
+#define PARTS_INITIAL_CAPACITY 4
+
+static bool is_operator(char *token) {
+    return !strcmp(token, "|") || !strcmp(token, "<") || !strcmp(token, ">") || !strcmp(token, ">>") ||
+           !strcmp(token, "<<") || !strcmp(token, "<<<");
+}
+
+// Writes the here-document or here-string into a sealed memory file, so that
+// the content never touches the file system and needs no extra process
+static int open_inline(struct command_part_t *part) {
+    int fd = memfd_create("flush-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        return -1;
+    }
 
-static struct list_t RUNNING_JOBS = {
-    .head = NULL,
-    .tail = NULL,
-    .size = 0};
+    ssize_t res;
+    for (size_t written = 0; written < part->in_length; written += res) {
+        res = write(fd, part->in_data + written, part->in_length - written);
+        if (res < 0) {
+            if (errno == EINTR) {
+                res = 0;
+                continue;
+            }
 
-static int check_if_background(struct command_tokens_t *tokens, struct command_execution_t *execution) {
-    char *last_token = tokens->tokens[tokens->token_count - 1];
-    if (strcmp(last_token, "&")) {
-        execution->background = false;
-        return 0;
+            close(fd);
+            return -1;
+        }
     }
 
-    execution->background = true;
-    if (tokens_remove(tokens, tokens->token_count - 1, tokens->token_count)) {
-        return 1;
+    // The reader can not tell the difference, but nothing can modify the
+    // content after this
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) ||
+        lseek(fd, 0, SEEK_SET)) {
+        close(fd);
+        return -1;
     }
 
-    return 0;
+    return fd;
 }
 
-static int get_file_output_from_command_line(struct command_tokens_t *tokens, struct command_part_t *execution) {
-    size_t index = tokens_search(tokens, ">");
-
-    int append_mode = 0;
+static int open_redirect(struct command_part_t *part) {
+    if (part->in_data != NULL) {
+        part->in = open_inline(part);
+        if (part->in == -1) {
+            return 2;
+        }
+    } else if (part->in_file != NULL) {
+        part->in = open(part->in_file, O_RDONLY);
+        if (part->in == -1) {
+            return 2;
+        }
+    }
 
-    if (index == -1) {
-        index = tokens_search(tokens, ">>");
-        if (index == -1) {
-            // No error occurred, but there was no output redirection tokens present
-            execution->out = -1;
-            return 0;
+    if (part->out_file != NULL) {
+        // Difference between trunc and append:
+        // https://man7.org/linux/man-pages/man2/open.2.html
+        if (part->append) {
+            part->out = open(part->out_file, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
         } else {
-            append_mode = 1;
+            part->out = open(part->out_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        }
+
+        if (part->out == -1) {
+            return 2;
         }
     }
 
-    char *filename_to_write = strdup(tokens->tokens[index + 1]);
-    if (filename_to_write == NULL) {
-        return 1;
+    return 0;
+}
+
+static struct command_part_t *next_part(struct command_execution_t *execution, size_t *capacity) {
+    if (execution->part_count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : PARTS_INITIAL_CAPACITY;
+        struct command_part_t *reallocated = arena_realloc(execution->arena, execution->parts,
+                                                           sizeof(struct command_part_t) * (*capacity),
+                                                           sizeof(struct command_part_t) * grown);
+        if (reallocated == NULL) {
+            return NULL;
+        }
+
+        execution->parts = reallocated;
+        *capacity = grown;
     }
 
-    // This call will free the above string if we do not duplicate it first
-    if (tokens_remove(tokens, index, index + 2)) {
-        free(filename_to_write);
-        return 1;
+    struct command_part_t *part = &execution->parts[execution->part_count++];
+    part->in = -1;
+    part->out = -1;
+    part->in_file = NULL;
+    part->heredoc = NULL;
+    part->in_data = NULL;
+    part->in_length = 0;
+    part->out_file = NULL;
+    part->append = false;
+    part->pid = -1;
+    part->running = false;
+    part->status = 0;
+    memset(&part->usage, 0, sizeof(struct rusage));
+    return part;
+}
+
+// Completes the part whose arguments start at the given index in the
+// tokens array, and have been compacted up to (but not including) end
+static int finish_part(struct command_part_t *part, char **tokens, size_t start, size_t end) {
+    part->argc = end - start;
+    if (part->argc == 0) {
+        return 2;  // Nothing to execute, e.g. "ls | | wc" or "> file"
     }
 
-    int fd;
-    if (append_mode == 1) {
-        // Difference between trunc and append:
-        // https://man7.org/linux/man-pages/man2/open.2.html
-        fd = open(filename_to_write, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
-    } else {
-        fd = open(filename_to_write, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    // exec calls require NULL termination of the vector so
+    // we handle it here for ease of use. The argc value shows
+    // one less than what is allocated, so any iteration or similar
+    // will not encounter any troubles
+    tokens[end] = NULL;
+    part->argv = &tokens[start];
+    part->executable = part->argv[0];
+    return 0;
+}
+
+static void free_exec(struct command_execution_t *execution) {
+    // Everything belonging to the command line, including the execution
+    // itself, lives in the arena
+    arena_free(execution->arena);
+}
+
+// Closes any file descriptors opened for the redirects of the part
+static void close_part_redirects(struct command_part_t *part) {
+    if (part->in >= 0) {
+        close(part->in);
     }
 
-    free(filename_to_write);
+    if (part->out >= 0) {
+        close(part->out);
+    }
+}
 
-    if (fd == -1) {
-        return 2;
+// Closes any file descriptors opened for the first part_count parts
+static void close_redirects(struct command_execution_t *execution, size_t part_count) {
+    for (size_t i = 0; i < part_count; i++) {
+        close_part_redirects(&execution->parts[i]);
+    }
+}
+
+// A here-string is fed to the command followed by a newline
+static int here_string(struct arena_t *arena, struct command_part_t *part, char *word) {
+    size_t length = strlen(word);
+    part->heredoc = NULL;
+    part->in_data = arena_alloc(arena, length + 1);
+    if (part->in_data == NULL) {
+        return 1;
     }
 
-    execution->out = fd;
+    memcpy(part->in_data, word, length);
+    part->in_data[length] = '\n';
+    part->in_length = length + 1;
     return 0;
 }
 
-static int get_file_input_from_command_line(struct command_tokens_t *tokens, struct command_part_t *execution) {
-    size_t index = tokens_search(tokens, "<");
+int commands_make_exec(char *command_line, struct command_tokens_t *tokens,
+                       struct command_execution_t **execution) {
+    int res = commands_make_plan(command_line, tokens, execution);
+    if (res) {
+        return res;
+    }
+
+    // Files are opened last, so that a parse error never leaves any open
+    return commands_open_redirects(*execution);
+}
 
-    if (index == -1) {
-        execution->in = -1;
-        return 0;
+int commands_make_plan(char *command_line, struct command_tokens_t *tokens,
+                       struct command_execution_t **execution) {
+    struct arena_t *arena = tokens->arena;
+    size_t count = tokens->token_count;
+    if (count == 0) {
+        return 1;  // Nothing to execute
     }
 
-    char *filename_to_read = strdup(tokens->tokens[index + 1]);
-    if (filename_to_read == NULL) {
+    *execution = arena_alloc(arena, sizeof(struct command_execution_t));
+    if (*execution == NULL) {
         return 1;
     }
 
-    // This call will free the above string if we do not duplicate it first
-    if (tokens_remove(tokens, index, index + 2)) {
-        free(filename_to_read);
+    (*execution)->arena = arena;
+    (*execution)->parts = NULL;
+    (*execution)->part_count = 0;
+    (*execution)->batch = NULL;
+
+    (*execution)->command_line = arena_strndup(arena, command_line, strlen(command_line));
+    if ((*execution)->command_line == NULL) {
         return 1;
     }
 
-    int fd = open(filename_to_read, O_RDONLY);
-    free(filename_to_read);
+    // Only a trailing "&" makes the command run in the background
+    (*execution)->background = !strcmp(tokens->tokens[count - 1], "&");
+    if ((*execution)->background) {
+        count--;
+    }
 
-    if (fd == -1) {
+    // A leading "time" reports resource usage of the whole pipeline, a
+    // leading "pipesize=SIZE" sets the capacity of its pipes and the prefixes
+    // described in policy.h set its scheduling and resource policy. These can
+    // be given in any order
+    size_t first = 0;
+    int res;
+    (*execution)->timed = false;
+    (*execution)->pipe_size = 0;
+    (*execution)->policy = NULL;
+    (*execution)->cgroup = NULL;
+    for (; first < count; first++) {
+        if (!strcmp(tokens->tokens[first], "time")) {
+            (*execution)->timed = true;
+        } else if (!strncmp(tokens->tokens[first], "pipesize=", 9)) {
+            if (commands_parse_size(tokens->tokens[first] + 9, &(*execution)->pipe_size)) {
+                return 2;
+            }
+        } else if ((res = policy_parse(arena, &(*execution)->policy, tokens->tokens[first])) != POLICY_NONE) {
+            if (res == POLICY_INVALID) {
+                return 2;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // The arguments of every part are compacted in place in the token array,
+    // each followed by a NULL in the slot of the operator that ended it. Only
+    // the last part may need a slot beyond the tokens themselves
+    if (tokens->capacity <= count) {
+        char **reallocated = arena_realloc(arena, tokens->tokens, sizeof(char *) * tokens->capacity,
+                                           sizeof(char *) * (count + 1));
+        if (reallocated == NULL) {
+            return 1;
+        }
+
+        tokens->tokens = reallocated;
+        tokens->capacity = count + 1;
+    }
+
+    char **argv = tokens->tokens;
+    char *token;
+    size_t capacity = 0, start = 0, end = 0;
+    struct command_part_t *part = next_part(*execution, &capacity);
+    if (part == NULL) {
+        return 1;
+    }
+
+    // Single pass over the tokens. Redirections apply to the part they occur
+    // in, and if the same stream is redirected more than once the last one wins
+    for (size_t i = first; i < count; i++) {
+        token = argv[i];
+
+        if (!strcmp(token, "|")) {
+            if (finish_part(part, argv, start, end)) {
+                return 2;
+            }
+
+            start = ++end;  // Skip the slot holding the NULL terminator
+            part = next_part(*execution, &capacity);
+            if (part == NULL) {
+                return 1;
+            }
+
+            continue;
+        }
+
+        if (!strcmp(token, "<") || !strcmp(token, ">") || !strcmp(token, ">>")) {
+            // Redirection needs a file name
+            if (i + 1 >= count || is_operator(argv[i + 1])) {
+                return 2;
+            }
+
+            if (token[0] == '<') {
+                part->in_file = argv[++i];
+                part->heredoc = NULL;
+                part->in_data = NULL;
+            } else {
+                part->out_file = argv[++i];
+                part->append = token[1] == '>';
+            }
+
+            continue;
+        }
+
+        if (!strcmp(token, "<<") || !strcmp(token, "<<<")) {
+            // Both need a delimiter or a word
+            if (i + 1 >= count || is_operator(argv[i + 1])) {
+                return 2;
+            }
+
+            part->in_file = NULL;
+            if (token[2] == '<') {
+                if (here_string(arena, part, argv[++i])) {
+                    return 1;
+                }
+            } else {
+                // The body is filled in by the caller
+                part->heredoc = argv[++i];
+                part->in_data = NULL;
+                part->in_length = 0;
+            }
+
+            continue;
+        }
+
+        argv[end++] = token;
+    }
+
+    if (finish_part(part, argv, start, end)) {
         return 2;
     }
 
-    execution->in = fd;
+    tokens_finish(tokens);  // The tokens now belong to the execution
     return 0;
 }
 
-static void free_exec(struct command_execution_t *execution) {
-    struct command_part_t *part;
+bool commands_has_heredoc(struct command_execution_t *execution) {
     for (size_t i = 0; i < execution->part_count; i++) {
-        part = &execution->parts[i];
-        // Free all the argument strings
-        for (size_t j = 0; j < part->argc; j++) {
-            free(part->argv[j]);
+        if (execution->parts[i].heredoc != NULL) {
+            return true;
         }
+    }
 
-        free(part->argv);
+    return false;
+}
+
+int commands_open_redirects(struct command_execution_t *execution) {
+    for (size_t i = 0; i < execution->part_count; i++) {
+        if (open_redirect(&execution->parts[i])) {
+            int error = errno;
+            close_redirects(execution, i + 1);
+            errno = error;
+            return 2;
+        }
     }
 
-    free(execution->parts);
-    free(execution->command_line);
-    free(execution);
+    return 0;
 }
 
-// Function for handling the cd command
-int change_wkd(struct command_part_t *part) {
-    // check if argv has 2 or more args
-    if (part->argc < 2) {
-        printf("Please provide a target directory to change to\n");
-        return -1;
+// Copies the string into the arena, or returns NULL if it is NULL. If item is
+// not NULL, every "{}" in the string is replaced by it
+static char *copy_string(struct arena_t *arena, char *str, const char *item, bool *failed) {
+    if (str == NULL) {
+        return NULL;
     }
 
-    // Check if passed argument is a legal dir
-    if (chdir(part->argv[1]) == -1) {
-        printf("Couldn't find target directory \"%s\"\n", part->argv[1]);
-        return -1;
+    size_t length = strlen(str), placeholders = 0;
+    char *placeholder;
+    for (placeholder = item != NULL ? strstr(str, "{}") : NULL; placeholder != NULL;
+         placeholder = strstr(placeholder + 2, "{}")) {
+        placeholders++;
     }
 
-    return 0;
-}
+    if (placeholders == 0) {
+        char *copy = arena_strndup(arena, str, length);
+        if (copy == NULL) {
+            *failed = true;
+        }
 
-int commands_make_exec(char *command_line, struct command_tokens_t *tokens,
-                       struct command_execution_t **execution) {
-    *execution = malloc(sizeof(struct command_execution_t));
-    if (*execution == NULL) {
-        return 1;
+        return copy;
     }
 
-    // Do this check early so we can use original tokens, which
-    // is freed at a later point
-    if (check_if_background(tokens, *execution)) {
-        free(*execution);
-        return 1;
+    size_t item_length = strlen(item);
+    char *copy = arena_alloc(arena, length + placeholders * item_length - placeholders * 2 + 1);
+    if (copy == NULL) {
+        *failed = true;
+        return NULL;
+    }
+
+    char *current = copy;
+    while ((placeholder = strstr(str, "{}")) != NULL) {
+        memcpy(current, str, placeholder - str);
+        current += placeholder - str;
+        memcpy(current, item, item_length);
+        current += item_length;
+        str = placeholder + 2;
     }
 
-    struct command_tokens_t *parts;
-    size_t part_count;
+    strcpy(current, str);
+    return copy;
+}
+
+int commands_copy_plan(struct command_execution_t *source, struct command_execution_t **execution) {
+    return commands_instantiate(source, NULL, execution);
+}
 
-    if (tokens_split("|", tokens, &part_count, &parts)) {
-        free(*execution);
+int commands_instantiate(struct command_execution_t *source, const char *item,
+                         struct command_execution_t **execution) {
+    struct arena_t *arena = arena_create();
+    if (arena == NULL) {
         return 1;
     }
 
-    (*execution)->part_count = part_count;
-    (*execution)->parts = malloc(sizeof(struct command_part_t) * part_count);
-    if ((*execution)->parts == NULL) {
-        free(*execution);
-        free(parts);
+    struct command_execution_t *copy = arena_alloc(arena, sizeof(struct command_execution_t));
+    if (copy == NULL) {
+        arena_free(arena);
         return 1;
     }
 
-    (*execution)->command_line = strdup(command_line);
-    if ((*execution)->command_line == NULL) {
-        free((*execution)->parts);
-        free(*execution);
-        free(parts);
+    bool failed = false;
+    copy->arena = arena;
+    copy->background = source->background;
+    copy->timed = source->timed;
+    copy->pipe_size = source->pipe_size;
+    copy->batch = NULL;
+    copy->cgroup = NULL;
+    copy->policy = policy_copy(arena, source->policy, &failed);
+    copy->part_count = source->part_count;
+    copy->command_line = copy_string(arena, source->command_line, item, &failed);
+    copy->parts = arena_alloc(arena, sizeof(struct command_part_t) * source->part_count);
+    if (failed || copy->parts == NULL) {
+        arena_free(arena);
         return 1;
     }
 
-    struct command_tokens_t *part_tokens;
-    struct command_part_t *part;
-    for (size_t i = 0; i < part_count; i++) {
-        part_tokens = &parts[i];
-        part = &((*execution)->parts[i]);
-        if (get_file_input_from_command_line(part_tokens, part) || get_file_output_from_command_line(part_tokens, part)) {
-            free((*execution)->parts);
-            free((*execution)->command_line);
-            free(*execution);
-            free(parts);
-            return 2;
+    struct command_part_t *from, *to;
+    for (size_t i = 0; i < source->part_count; i++) {
+        from = &source->parts[i];
+        to = &copy->parts[i];
+
+        // Per-run state is not copied
+        to->in = -1;
+        to->out = -1;
+        to->pid = -1;
+        to->running = false;
+        to->status = 0;
+        memset(&to->usage, 0, sizeof(struct rusage));
+
+        to->append = from->append;
+        to->in_file = copy_string(arena, from->in_file, item, &failed);
+        to->heredoc = copy_string(arena, from->heredoc, NULL, &failed);
+        to->in_length = from->in_length;
+        to->in_data = from->in_data == NULL ? NULL : arena_alloc(arena, from->in_length);
+        if (from->in_data != NULL && to->in_data != NULL) {
+            memcpy(to->in_data, from->in_data, from->in_length);
         }
 
-        part->argc = part_tokens->token_count;
-        part->argv = malloc(sizeof(char *) * (part->argc + 1));
-        if (part->argv == NULL) {
-            // Free everything previous to this iteration
-            (*execution)->part_count = i - 1;
-            free_exec(*execution);
-            free(parts);
-            return 2;
+        to->out_file = copy_string(arena, from->out_file, item, &failed);
+        to->argc = from->argc;
+        to->argv = arena_alloc(arena, sizeof(char *) * (from->argc + 1));
+        if (failed || to->argv == NULL || (from->in_data != NULL && to->in_data == NULL)) {
+            arena_free(arena);
+            return 1;
         }
 
-        for (size_t j = 0; j < part->argc; j++) {
-            part->argv[j] = strdup(part_tokens->tokens[j]);
+        for (int j = 0; j < from->argc; j++) {
+            to->argv[j] = copy_string(arena, from->argv[j], item, &failed);
+        }
 
-            // Unallocate everything we allocated if this fails
-            if (part->argv[j] == NULL) {
-                // Set argc and part_count to i so we can use free_exec
-                part->argc = j;
-                (*execution)->part_count = i;
-                free_exec(*execution);
-                free(parts);
-                return 2;
-            }
+        if (failed) {
+            arena_free(arena);
+            return 1;
         }
 
-        part->executable = part->argv[0];
+        to->argv[to->argc] = NULL;
+        to->executable = to->argv[0];
+    }
+
+    *execution = copy;
+    return 0;
+}
+
+void commands_discard(struct command_execution_t *execution) {
+    close_redirects(execution, execution->part_count);
+    free_exec(execution);
+}
 
-        // exec calls require NULL termination of the vector so
-        // we handle it here for ease of use. The argc value shows
-        // one less than what is allocated, so any iteration or similar
-        // will not encounter any troubles
-        part->argv[part->argc] = NULL;
+static void close_parent_fds(struct command_part_t *part, bool pipe) {
+    // Make sure we close fds in this process aswell
+    if (part->out >= 0) {
+        close(part->out);
+    }
 
-        tokens_finish(part_tokens);  // We are done with these now
+    if (!pipe && part->in >= 0) {
+        close(part->in);
     }
+}
 
-    free(parts);
-    return 0;
+// Runs a file that is not an executable as a shell script, the way execvp
+// does. Returns like posix_spawn
+static int spawn_script(pid_t *pid, const char *path, struct command_part_t *part,
+                        posix_spawn_file_actions_t *actions, posix_spawnattr_t *attr) {
+    // argv of the part, including its NULL terminator, with the shell and
+    // the path in place of the name
+    char **argv = malloc(sizeof(char *) * (part->argc + 2));
+    if (argv == NULL) {
+        return ENOMEM;
+    }
+
+    argv[0] = "/bin/sh";
+    argv[1] = (char *)path;
+    memcpy(argv + 2, part->argv + 1, sizeof(char *) * part->argc);
+    int res = posix_spawn(pid, "/bin/sh", actions, attr, argv, environ);
+    free(argv);
+    return res;
+}
+
+// Launches the part without copying the page tables of the shell. The I/O
+// redirections are expressed as file actions applied in the child
+static pid_t spawn_part(struct command_part_t *part) {
+    posix_spawn_file_actions_t actions;
+    if (posix_spawn_file_actions_init(&actions)) {
+        part->status = W_EXITCODE(EXIT_FAILURE, 0);
+        return -1;
+    }
+
+    if (part->out >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, part->out, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, part->out);
+    }
+
+    if (part->in >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, part->in, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, part->in);
+    }
+
+    // SIGCHLD is blocked in the shell when children are watched, which the
+    // child would otherwise inherit
+    posix_spawnattr_t attributes, *attr = NULL;
+    if (CHILD_FD >= 0 && !posix_spawnattr_init(&attributes)) {
+        attr = &attributes;
+        posix_spawnattr_setsigmask(attr, &CHILD_SIGMASK);
+        posix_spawnattr_setflags(attr, POSIX_SPAWN_SETSIGMASK);
+    }
+
+    pid_t pid;
+    bool cached;
+    const char *path = pathcache_lookup(part->executable, &cached);
+    int res = path == NULL ? ENOENT : posix_spawn(&pid, path, &actions, attr, part->argv, environ);
+
+    // The cached path no longer works, e.g. because the executable was
+    // moved. Look it up again
+    if (cached && (res == ENOENT || res == EACCES || res == ENOTDIR)) {
+        pathcache_forget(part->executable);
+        path = pathcache_lookup(part->executable, &cached);
+        res = path == NULL ? ENOENT : posix_spawn(&pid, path, &actions, attr, part->argv, environ);
+    }
+
+    if (res == ENOEXEC) {
+        res = spawn_script(&pid, path, part, &actions, attr);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    if (attr != NULL) {
+        posix_spawnattr_destroy(attr);
+    }
+
+    if (res) {
+        // Same exit status as when exec fails in a forked child
+        fprintf(stderr, "Failed to execute \"%s\": %s\n", part->executable, strerror(res));
+        part->status = W_EXITCODE(EXIT_FAILURE, 0);
+        return -1;
+    }
+
+    return pid;
+}
+
+// Runs an internal command in the shell process, with I/O redirection
+// applied temporarily
+static int run_in_process(const struct builtin_t *builtin, struct command_part_t *part) {
+    int saved_out = -1, saved_in = -1;
+
+    // Make sure nothing buffered before this ends up in the redirected output
+    fflush(stdout);
+
+    if (part->out >= 0) {
+        saved_out = dup(STDOUT_FILENO);
+        dup2(part->out, STDOUT_FILENO);
+        close(part->out);
+    }
+
+    if (part->in >= 0) {
+        saved_in = dup(STDIN_FILENO);
+        dup2(part->in, STDIN_FILENO);
+        close(part->in);
+    }
+
+    int status = builtin->run(part);
+    fflush(stdout);
+
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+
+    if (saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+
+    part->in = -1;
+    part->out = -1;
+    return status;
+}
+
+// Records how long starting the process of a part took. posix_spawn returns
+// once the child has exec'd, while a forked child records its own exec
+static void record_launch(int counter, struct command_part_t *part, pid_t pid) {
+    if (pid == -1) {
+        stats_count(STATS_LAUNCH_FAILURES);
+        return;
+    }
+
+    long start = part->started.tv_sec * 1000000000L + part->started.tv_nsec, end = stats_now();
+    stats_count(counter);
+    stats_record(STATS_LAUNCH, end - start);
+
+    if (trace_enabled) {
+        trace_process(pid, part->executable);
+        trace_event(counter == STATS_FORKS ? "fork" : "spawn", start, end, pid, part->executable);
+    }
 }
 
-static void execute_part(struct command_part_t *part, bool pipe) {
-    // chack if executable is cd
-    if (strcmp(part->executable, "cd") == 0) {
+// Runs the part at the given index. pending is the read end of the pipe out
+// of this part, which the next part reads from, or -1. It is closed in forked
+// children so that they do not keep their own output pipe open
+static void execute_part(struct command_execution_t *execution, size_t index, int pending) {
+    struct command_part_t *part = &execution->parts[index];
+    bool pipe = index < execution->part_count - 1, pipeline = execution->part_count > 1;
+    const struct builtin_t *builtin = builtins_find(part->executable);
+    clock_gettime(CLOCK_MONOTONIC, &part->started);
+
+    // Internal commands that are not part of a pipeline do not need a
+    // process. Those acting on the shell run in it at the end of one too, by
+    // then every other part is started and reading from its pipe
+    if (builtin != NULL && (!pipeline || (builtin->in_process && !pipe))) {
+        stats_count(STATS_BUILTINS);
         part->pid = -1;
-        change_wkd(part);
+        part->status = W_EXITCODE(run_in_process(builtin, part), 0);
+        clock_gettime(CLOCK_MONOTONIC, &part->finished);
+        if (trace_enabled) {
+            trace_event("builtin", trace_time(&part->started), trace_time(&part->finished), 0,
+                        part->executable);
+        }
+        return;
+    }
+
+    // Anything still buffered would otherwise be written a second time by
+    // children that exit without exec'ing, e.g. "jobs", or end up after the
+    // output of the child
+    fflush(stdout);
+
+    // Parts that only copy data are done by a forked copy of the shell,
+    // which keeps the data in the kernel and saves an exec
+    bool copy = builtin == NULL && COPY_FASTPATH && mover_is_copy(part);
+    stats_count(builtin != NULL ? STATS_BUILTINS : copy ? STATS_COPIES : STATS_EXTERNAL);
+
+    pid_t pid;
+    // A policy can not be expressed as spawn attributes, so it is applied in
+    // a forked child
+    if (SPAWN_BACKEND == COMMANDS_SPAWN_POSIX && builtin == NULL && !copy && execution->policy == NULL) {
+        pid = spawn_part(part);
+        record_launch(STATS_SPAWNS, part, pid);
+        close_parent_fds(part, pipe);
+        part->pid = pid;
+        part->running = pid != -1;
+        if (pid == -1) {
+            part->finished = part->started;
+        }
 
         return;
     }
 
-    pid_t pid = fork();
+    // Resolve the executable before forking, so the cache of this process
+    // is the one that gets filled
+    bool cached;
+    const char *path = builtin != NULL || copy ? NULL : pathcache_lookup(part->executable, &cached);
+
+    // The cached path no longer works, e.g. because the executable was
+    // moved. Checking costs far less than every later child failing its exec
+    if (path != NULL && cached && access(path, X_OK)) {
+        pathcache_forget(part->executable);
+        path = pathcache_lookup(part->executable, &cached);
+    }
+    if (builtin != NULL && builtin->prepare != NULL) {
+        builtin->prepare();
+    }
+
+    pid = fork();
 
     // In child
     if (pid == 0) {
+        if (CHILD_FD >= 0) {
+            sigprocmask(SIG_SETMASK, &CHILD_SIGMASK, NULL);
+        }
+
+        // exec resets the handlers of the shell, but builtins and the data
+        // mover do not exec. CTRL + C has to stop them like any command
+        signal(SIGINT, SIG_DFL);
+
+        // The pipes are close-on-exec, but builtins and the data mover run
+        // without exec'ing. Those would never see EPIPE while holding this
+        if (pending >= 0) {
+            close(pending);
+        }
+
+        if (execution->policy != NULL && policy_apply(execution->policy, index, execution->cgroup)) {
+            exit(EXIT_FAILURE);
+        }
+
         if (part->out >= 0) {
             dup2(part->out, STDOUT_FILENO);
             close(part->out);
@@ -253,46 +751,208 @@ static void execute_part(struct command_part_t *part, bool pipe) {
             close(part->in);
         }
 
-        // Internal command that prints all running background processes. We
-        // run this in a forked process so that we can support pipes and
-        // redirects for this command which could be useful for things like
-        // searching for active processes (e.g. "jobs | grep rsync")
-        if (strcmp(part->executable, "jobs") == 0) {
-            if (commands_get_running_count() > 0) {
-                printf("Jobs running in background (%ld):\n", commands_get_running_count());
-                struct command_execution_t *exec;
-                for (size_t i = 0; i < commands_get_running_count(); i++) {
-                    exec = commands_get_running(i);
-                    printf(" PID %d - \"%s\"\n", exec->parts[exec->part_count - 1].pid, exec->command_line);
-                }
-            } else {
-                printf("There are no jobs running in the background\n");
-            }
+        // Internal commands run in this forked copy of the shell so that
+        // they can be part of pipes
+        if (builtin != NULL) {
+            exit(builtin->run(part));
+        }
 
-            exit(EXIT_SUCCESS);
+        if (copy) {
+            exit(mover_run(part));
+        }
+
+        if (trace_enabled) {
+            trace_exec(part->executable);
         }
 
         // execution->argv is already null terminated
+        if (path != NULL) {
+            execv(path, part->argv);
+        }
+
+        // Either the executable was not found, or it is a script without
+        // an interpreter line. execvp fails on the first, and runs the
+        // second with /bin/sh. Failures are reported like in spawn_part
         execvp(part->executable, part->argv);
-        // Should never reach this point
+        fprintf(stderr, "Failed to execute \"%s\": %s\n", part->executable, strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    // Make sure we close fds in this process aswell
-    if (part->out >= 0) {
-        close(part->out);
+    record_launch(STATS_FORKS, part, pid);
+    close_parent_fds(part, pipe);
+    part->pid = pid;
+    part->running = pid != -1;
+    if (pid == -1) {
+        part->status = W_EXITCODE(EXIT_FAILURE, 0);
+        part->finished = part->started;
     }
+}
 
-    if (!pipe && part->in >= 0) {
-        close(part->in);
+static void record_exit(struct command_part_t *part, int status, struct rusage *usage) {
+    clock_gettime(CLOCK_MONOTONIC, &part->finished);
+    part->running = false;
+    part->status = status;
+    part->usage = *usage;
+    if (trace_enabled) {
+        trace_event("run", trace_time(&part->started), trace_time(&part->finished), part->pid,
+                    part->executable);
     }
+}
 
-    part->pid = pid;
+static double elapsed(struct timespec *from, struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static double seconds(struct timeval *time) {
+    return time->tv_sec + time->tv_usec / 1e6;
+}
+
+// Prints the resources used by every part of the command, and in total
+static void print_usage(struct command_execution_t *execution) {
+    struct command_part_t *part;
+    struct timespec *first = &execution->parts[0].started, *last = &execution->parts[0].finished;
+    double user = 0, sys = 0;
+    long max_rss = 0, voluntary = 0, involuntary = 0;
+
+    for (size_t i = 0; i < execution->part_count; i++) {
+        part = &execution->parts[i];
+        fprintf(stdout, "  %-3zu %-16s real %.3fs user %.3fs sys %.3fs maxrss %ld KiB ctxsw %ld/%ld\n", i,
+                part->executable, elapsed(&part->started, &part->finished), seconds(&part->usage.ru_utime),
+                seconds(&part->usage.ru_stime), part->usage.ru_maxrss, part->usage.ru_nvcsw,
+                part->usage.ru_nivcsw);
+
+        if (elapsed(&part->finished, last) < 0) {
+            last = &part->finished;
+        }
+
+        user += seconds(&part->usage.ru_utime);
+        sys += seconds(&part->usage.ru_stime);
+        voluntary += part->usage.ru_nvcsw;
+        involuntary += part->usage.ru_nivcsw;
+        if (part->usage.ru_maxrss > max_rss) {
+            max_rss = part->usage.ru_maxrss;
+        }
+    }
+
+    fprintf(stdout, "  %-20s real %.3fs user %.3fs sys %.3fs maxrss %ld KiB ctxsw %ld/%ld\n", "total",
+            elapsed(first, last), user, sys, max_rss, voluntary, involuntary);
+}
+
+// The limit for unprivileged processes, see pipe(7)
+static size_t pipe_max_size() {
+    if (PIPE_MAX_SIZE > 0) {
+        return PIPE_MAX_SIZE;
+    }
+
+    FILE *file = fopen("/proc/sys/fs/pipe-max-size", "r");
+    if (file == NULL || fscanf(file, "%zu", &PIPE_MAX_SIZE) != 1) {
+        PIPE_MAX_SIZE = 1024 * 1024;  // The default limit
+    }
+
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    return PIPE_MAX_SIZE;
+}
+
+// Sets the capacity of a pipe. Failing to do so is not an error, the pipe just
+// keeps the default capacity
+static void resize_pipe(int fd, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    if (size > pipe_max_size()) {
+        size = pipe_max_size();
+    }
+
+    fcntl(fd, F_SETPIPE_SZ, (int)size);
+}
+
+// Prints the exit status of a completed command line, and the resources it
+// used if it was timed
+static void report_exit(struct command_execution_t *execution) {
+    int status = commands_exit_status(execution);
+    if (WIFEXITED(status)) {
+        fprintf(stdout, "Exit status [%s] = %d\n", execution->command_line,
+                WEXITSTATUS(status));
+    }
+
+    if (execution->timed) {
+        print_usage(execution);
+    }
+}
+
+// Reports a completed command line, accounts for it in its batch and frees it
+static void complete_exec(struct command_execution_t *execution) {
+    report_exit(execution);
+
+    int status = commands_exit_status(execution);
+    if (!execution->background) {
+        // Like in sh, a command killed by a signal gives 128 plus its number
+        LAST_STATUS = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+
+    struct command_batch_t *batch = execution->batch;
+    if (batch != NULL) {
+        batch->running--;
+        batch->completed++;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            batch->failed++;
+        }
+    }
+
+    if (execution->cgroup != NULL) {
+        policy_remove_cgroup(execution->cgroup);
+    }
+
+    free_exec(execution);
+}
+
+// Fails the parts from the given one on without starting their processes
+static void fail_parts(struct command_execution_t *execution, size_t first) {
+    for (size_t i = first; i < execution->part_count; i++) {
+        struct command_part_t *part = &execution->parts[i];
+        close_part_redirects(part);
+        clock_gettime(CLOCK_MONOTONIC, &part->started);
+        part->finished = part->started;
+        part->in = -1;
+        part->out = -1;
+        part->pid = -1;
+        part->running = false;
+        part->status = W_EXITCODE(EXIT_FAILURE, 0);
+    }
+}
+
+// Fails every part of a command line without starting any process
+static void cancel_exec(struct command_execution_t *execution) {
+    fail_parts(execution, 0);
+    complete_exec(execution);
 }
 
 void commands_execute(struct command_execution_t *execution) {
     struct command_part_t *part;
     int in = -1, fd[2];
+    bool cancelled = false;
+
+    stats_count(STATS_COMMAND_LINES);
+
+    // Every run of a command line with a cgroup policy gets its own cgroup.
+    // Running it outside one would silently drop the limits of the cgroup,
+    // so the command line is cancelled instead
+    if (execution->policy != NULL &&
+        policy_create_cgroup(execution->arena, execution->policy, &execution->cgroup)) {
+        cancel_exec(execution);
+        return;
+    }
+
+    // Like in sh, putting a command line in the background succeeds
+    if (!execution->background) {
+        FOREGROUND = execution;
+    } else {
+        LAST_STATUS = EXIT_SUCCESS;
+    }
 
     // If there is no piping going on, this for loop will not run since
     // part_count will be 1. This means we don't need any special
@@ -300,7 +960,22 @@ void commands_execute(struct command_execution_t *execution) {
     for (size_t i = 0; i < (execution->part_count - 1); i++) {
         part = &execution->parts[i];
 
-        pipe(fd);
+        // Close-on-exec, so that no other part inherits this pipe. The parts
+        // using it get it through dup2, which clears the flag. Without a pipe
+        // the rest of the line is cancelled, and the parts already started
+        // are waited for below
+        if (pipe2(fd, O_CLOEXEC)) {
+            fprintf(stderr, "Failed to create pipe for [%s]: %s\n", execution->command_line, strerror(errno));
+            if (in != -1) {
+                close(in);
+            }
+
+            fail_parts(execution, i);
+            cancelled = true;
+            break;
+        }
+
+        resize_pipe(fd[1], execution->pipe_size ? execution->pipe_size : PIPE_SIZE);
 
         // This handles the case where someone is dumb and writes stuff
         // like "ls -l > test.txt | grep whatever", which would otherwise
@@ -322,7 +997,7 @@ void commands_execute(struct command_execution_t *execution) {
         }
 
         part->out = fd[1];
-        execute_part(part, true);
+        execute_part(execution, i, fd[0]);
 
         if (in != -1) {
             close(in);  // Close previous pipe read end
@@ -332,7 +1007,7 @@ void commands_execute(struct command_execution_t *execution) {
     }
 
     part = &execution->parts[execution->part_count - 1];
-    if (in != -1) {
+    if (in != -1 && !cancelled) {
         if (part->in >= 0) {
             // Warn the idiots
             fprintf(stderr, "Attempted I/O redirect into command that is part of pipeline at illegal position in command line [%s]! This redirection has been overwritten and ignored.\n", execution->command_line);
@@ -342,103 +1017,272 @@ void commands_execute(struct command_execution_t *execution) {
         part->in = in;
     }
 
-    execute_part(part, false);
+    if (!cancelled) {
+        execute_part(execution, execution->part_count - 1, -1);
+    }
+
+    bool started = false;
+    for (size_t i = 0; i < execution->part_count && !started; i++) {
+        started = execution->parts[i].running;
+    }
 
-    if (execution->background) {
-        if (llist_append_element(&RUNNING_JOBS, execution)) {
+    // If no process could be started there is nothing to wait for, and the
+    // command line is reported right away
+    if (execution->background && started) {
+        stats_count(STATS_BACKGROUND);
+        if (jobs_add(execution) == NULL) {
             printf("Failed to append command line [%s] to background task list\n", execution->command_line);
         }
         return;
     }
 
-    int status = 0;  // Default it to 0
-
-    pid_t pid;
+    int status;
+    pid_t pid, res;
+    struct command_part_t *waited;
+    struct rusage usage;
+    long wait_start = trace_begin();
     // Wait for all children to complete in order
     for (size_t i = 0; i < execution->part_count; i++) {
-        pid = execution->parts[i].pid;
-        if (pid == (pid_t)-1) {
-            continue;  // Can happen if no new process is spawned
+        waited = &execution->parts[i];
+        if (!waited->running) {
+            // Can happen if no new process is spawned
+            continue;
+        }
+
+        // CTRL + C interrupts the wait, but the child receives it aswell
+        pid = waited->pid;
+        while ((res = wait4(pid, &status, 0, &usage)) == -1 && errno == EINTR) {
         }
 
-        if (waitpid(pid, &status, 0) == -1) {
+        if (res == -1) {
             fprintf(stderr, "Error while waiting for PID %d [%s]\n", pid, execution->command_line);
-        } else if (!WIFEXITED(status)) {
+            waited->running = false;
+            continue;
+        }
+
+        record_exit(waited, status, &usage);
+        if (!WIFEXITED(status)) {
             fprintf(stderr, "Process did not exit normally for PID %d [%s]\n", pid,
                     execution->command_line);
         }
     }
 
-    if (WIFEXITED(status)) {
-        fprintf(stdout, "Exit status [%s] = %d\n", execution->command_line,
-                WEXITSTATUS(status));
+    trace_end("wait", wait_start, execution->command_line);
+    // Background lines that started no process end up here too, e.g. an item
+    // of "producer | parallel" while the producer is still running
+    if (FOREGROUND == execution) {
+        FOREGROUND = NULL;
     }
+    struct timespec *first = &execution->parts[0].started;
+    stats_record(STATS_FOREGROUND, stats_now() - (first->tv_sec * 1000000000L + first->tv_nsec));
+    complete_exec(execution);
+}
 
-    free_exec(execution);
+void commands_set_spawn_backend(int backend) {
+    SPAWN_BACKEND = backend;
 }
 
-size_t commands_get_running_count() {
-    return RUNNING_JOBS.size;
+void commands_set_copy_fastpath(bool enabled) {
+    COPY_FASTPATH = enabled;
 }
 
-struct command_execution_t *commands_get_running(size_t index) {
-    return (struct command_execution_t *)llist_get(&RUNNING_JOBS, index);
+int commands_parse_size(const char *text, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno || end == text || text[0] == '-') {
+        return 1;
+    }
+
+    // Binary suffixes, e.g. "1M" is 1048576 bytes
+    switch (*end) {
+        case 'k':
+        case 'K':
+            value *= 1024;
+            end++;
+            break;
+        case 'm':
+        case 'M':
+            value *= 1024 * 1024;
+            end++;
+            break;
+        case 'g':
+        case 'G':
+            value *= 1024 * 1024 * 1024;
+            end++;
+            break;
+    }
+
+    if (*end != '\0') {
+        return 1;
+    }
+
+    *size = value;
+    return 0;
 }
 
-void commands_cleanup_running() {
-    pid_t child;
-    int status;
+void commands_set_pipe_size(size_t size) {
+    PIPE_SIZE = size;
+}
 
-    struct command_execution_t **running_jobs = malloc(sizeof(struct command_execution_t *) * RUNNING_JOBS.size);
-    llist_elements(&RUNNING_JOBS, (void **)running_jobs);
+size_t commands_get_pipe_size() {
+    return PIPE_SIZE;
+}
 
-    // Flag for later removals. This avoids concurrent modification, which
-    // in this case results in us having free'd some of the blocks that are
-    // pointed to by running_jobs above
-    bool *remove_flag = malloc(sizeof(bool) * RUNNING_JOBS.size);
-    memset(remove_flag, 0, sizeof(bool) * RUNNING_JOBS.size);
+size_t commands_get_pipe_max_size() {
+    return pipe_max_size();
+}
 
-    struct command_execution_t *current;
-    struct command_execution_t *tmp;
-    while ((child = waitpid(-1, &status, WNOHANG)) > 0) {
-        current = NULL;
-        for (size_t i = 0; i < RUNNING_JOBS.size; i++) {
-            // Only consider the last part
-            tmp = running_jobs[i];
-            if (tmp->parts[tmp->part_count - 1].pid == child) {
-                current = tmp;
-                remove_flag[i] = true;
-                break;
+void commands_set_pipefail(bool enabled) {
+    PIPEFAIL = enabled;
+}
+
+bool commands_get_pipefail() {
+    return PIPEFAIL;
+}
+
+int commands_exit_status(struct command_execution_t *execution) {
+    int status = execution->parts[execution->part_count - 1].status;
+    if (!PIPEFAIL) {
+        return status;
+    }
+
+    // The last part that did not succeed decides the status
+    for (size_t i = execution->part_count; i > 0; i--) {
+        status = execution->parts[i - 1].status;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return status;
+        }
+    }
+
+    return status;
+}
+
+int commands_last_status() {
+    return LAST_STATUS;
+}
+
+void commands_set_last_status(int status) {
+    LAST_STATUS = status;
+}
+
+int commands_watch_children() {
+    if (CHILD_FD >= 0) {
+        return CHILD_FD;
+    }
+
+    // SIGCHLD has to be blocked for it to be delivered through the signalfd
+    // instead of its (default, ignoring) disposition
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &CHILD_SIGMASK)) {
+        return -1;
+    }
+
+    CHILD_FD = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (CHILD_FD == -1) {
+        sigprocmask(SIG_SETMASK, &CHILD_SIGMASK, NULL);
+    }
+
+    return CHILD_FD;
+}
+
+// Empties the signalfd. Several exits can be merged into one notification,
+// so this is only used as a wake up, the children are found with wait4()
+static void drain_child_fd() {
+    struct signalfd_siginfo info[16];
+    while (read(CHILD_FD, info, sizeof(info)) > 0) {
+    }
+}
+
+// Records the exit of a part of the foreground command line. A builtin at
+// the end of a pipeline that waits for jobs, e.g. "ls | parallel gzip", can
+// reap the other parts of its own command line
+static void reap_foreground(pid_t pid, int status, struct rusage *usage) {
+    for (size_t i = 0; FOREGROUND != NULL && i < FOREGROUND->part_count; i++) {
+        struct command_part_t *part = &FOREGROUND->parts[i];
+        if (part->running && part->pid == pid) {
+            record_exit(part, status, usage);
+            if (!WIFEXITED(status)) {
+                fprintf(stderr, "Process did not exit normally for PID %d [%s]\n", pid,
+                        FOREGROUND->command_line);
             }
+            return;
         }
+    }
+}
+
+// Reaps finished background jobs. With options set to 0 this blocks until
+// every job has completed, with WNOHANG it only reaps those already done. If
+// a batch is given, this stops once at most limit of its jobs are running.
+// Returns the amount of jobs that completed
+static size_t reap_running(int options, struct command_batch_t *batch, size_t limit) {
+    if (CHILD_FD >= 0) {
+        drain_child_fd();
+    }
 
-        // This means that we have some piped command running in the background,
-        // and we have just gotten a signal that one of the earlier commands have
-        // finished. This does not mean that the entire command is done, so we wait
-        // until the last part of the command completes before we print that it is
-        // done. This does mean that if an error code occurs in one of the earlier
-        // parts this is lost, but that is an issue for another day
-        if (current == NULL) {
+    size_t completed = 0, index;
+    int status;
+    pid_t pid;
+    struct job_t *job;
+    struct command_execution_t *current;
+    struct rusage usage;
+
+    // Nothing can have finished if nothing is running. This keeps the cost of
+    // calling this once per line low for scripts that never use "&". Every
+    // iteration handles one exited child, which is looked up by its PID, so
+    // the work done is proportional to the amount of children that exited
+    while (jobs_count() > 0 && (batch == NULL || batch->running > limit) &&
+           (pid = wait4(-1, &status, options, &usage)) > 0) {
+        job = jobs_find_pid(pid, &index);
+        if (job == NULL) {
+            reap_foreground(pid, status, &usage);
             continue;
         }
 
+        current = job->execution;
+        jobs_part_exited(job, index);
+        record_exit(&current->parts[index], status, &usage);
+
         if (!WIFEXITED(status)) {
-            fprintf(stderr, "Process did not exit normally for PID %d [%s]\n", child,
+            fprintf(stderr, "Process did not exit normally for PID %d [%s]\n", pid,
                     current->command_line);
-        } else {
-            fprintf(stdout, "Exit status [%s] = %d\n", current->command_line,
-                    WEXITSTATUS(status));
         }
-    }
 
-    for (size_t i = 0; i < RUNNING_JOBS.size; i++) {
-        if (remove_flag[i]) {
-            free_exec(running_jobs[i]);
+        // Earlier parts of a pipeline can finish before the last one, and
+        // the other way around. The job is done once every part has exited
+        if (job->running > 0) {
+            continue;
         }
+
+        jobs_remove(job);
+        complete_exec(current);
+        completed++;
     }
 
-    free(running_jobs);
+    return completed;
+}
+
+size_t commands_cleanup_running() {
+    return reap_running(WNOHANG, NULL, 0);
+}
+
+void commands_wait_running() {
+    reap_running(0, NULL, 0);
+}
+
+int commands_wait_batch(struct command_batch_t *batch, size_t limit) {
+    reap_running(0, batch, limit);
+    return batch->running > limit;
+}
 
-    llist_remove_by_flag(&RUNNING_JOBS, remove_flag);
-    free(remove_flag);
+void commands_detach_batch(struct command_batch_t *batch) {
+    for (size_t id = 1; id <= jobs_last_id() && batch->running > 0; id++) {
+        struct job_t *job = jobs_get(id);
+        if (job != NULL && job->execution->batch == batch) {
+            job->execution->batch = NULL;
+            batch->running--;
+        }
+    }
 }
@@ -4,7 +4,10 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
 
+#include "arena.h"
 #include "tokenizer.h"
 
 /**
@@ -22,6 +25,32 @@ struct command_part_t {
      * The file descriptor for stdin, -1 if not specified.
      */
     int in;
+    /**
+     * The file stdout is redirected to, NULL if not specified
+     */
+    char *out_file;
+    /**
+     * If output should be appended to out_file instead of truncating it
+     */
+    bool append;
+    /**
+     * The file stdin is redirected from, NULL if not specified
+     */
+    char *in_file;
+    /**
+     * The delimiter of a here-document ("<<EOF"), NULL if not specified. The
+     * body is read by the caller, see commands_has_heredoc.
+     */
+    char *heredoc;
+    /**
+     * Content for stdin from a here-document or here-string ("<<< text"),
+     * NULL if not specified. Fed through a sealed memfd, never a file.
+     */
+    char *in_data;
+    /**
+     * The length of in_data
+     */
+    size_t in_length;
     /**
      * The name of the executable. If the command is e.g. "ls -l"
      * this would be "ls"
@@ -36,7 +65,8 @@ struct command_part_t {
      *
      * The argument values, for direct use with exec calls. Should
      * therefore have NULL as the last element as index argc, meaning
-     * this should have a size of sizeof(char *) * (argc + 1)
+     * this should have a size of sizeof(char *) * (argc + 1). Points
+     * into the token array of the command line.
      */
     char **argv;
     /**
@@ -47,6 +77,56 @@ struct command_part_t {
      * command.
      */
     pid_t pid;
+    /**
+     * @brief If the process of this part has been started, but not yet
+     * reaped
+     */
+    bool running;
+    /**
+     * @brief Wait status of this part once it has completed. Also set if no
+     * process was started for it, e.g. if it was an internal command or
+     * launching it failed.
+     */
+    int status;
+    /**
+     * @brief When the process for this part was started, or the internal
+     * command began running
+     */
+    struct timespec started;
+    /**
+     * @brief When this part completed
+     */
+    struct timespec finished;
+    /**
+     * @brief Resources used by the process of this part, as reported when it
+     * was reaped. All zero for internal commands run in the shell.
+     */
+    struct rusage usage;
+};
+
+// Launch commands with fork() and exec in the child
+#define COMMANDS_SPAWN_FORK 0
+// Launch commands with posix_spawnp(), which avoids copying the page tables
+// of the shell. Internal commands that run in a child still use fork().
+#define COMMANDS_SPAWN_POSIX 1
+
+/**
+ * Counters for a group of background command lines started together, e.g. by
+ * the parallel builtin. Updated as the command lines complete.
+ */
+struct command_batch_t {
+    /**
+     * Command lines that have been started, but have not completed yet
+     */
+    size_t running;
+    /**
+     * Command lines that have completed
+     */
+    size_t completed;
+    /**
+     * Completed command lines with a non-zero (combined) exit status
+     */
+    size_t failed;
 };
 
 /**
@@ -69,11 +149,44 @@ struct command_execution_t {
      * If this command execution should run as a background process.
      */
     bool background;
+    /**
+     * If resource usage should be reported once the command completes, i.e.
+     * if the command line was prefixed with "time"
+     */
+    bool timed;
+    /**
+     * Capacity of the pipes between the parts of this command line, from a
+     * leading "pipesize=SIZE". 0 uses the global setting.
+     */
+    size_t pipe_size;
+    /**
+     * The batch this command line is accounted in, or NULL. The running
+     * count must be incremented before the command line is executed.
+     */
+    struct command_batch_t *batch;
+    /**
+     * Scheduling and resource policy from the prefixes of the command line,
+     * or NULL. See policy.h.
+     */
+    struct command_policy_t *policy;
+    /**
+     * The cgroup created for this run of the command line, or NULL
+     */
+    char *cgroup;
+    /**
+     * The arena holding this structure and everything it points to. The
+     * whole command line is released at once by freeing this.
+     */
+    struct arena_t *arena;
 };
 
 /**
  * @brief Parses the given tokens to plan a command execution
  *
+ * All memory is allocated from the arena of the given tokens. If this call
+ * succeeds the execution takes ownership of the arena, which is then free'd
+ * once the command has completed. If it fails, the caller keeps ownership.
+ *
  * @param command_line The command line as a string
  * @param tokens The parsed tokens based on the command line string
  * @param execution Pointer to execution variable. Used to output the result of this call.
@@ -81,6 +194,68 @@ struct command_execution_t {
  */
 int commands_make_exec(char *command_line, struct command_tokens_t *tokens, struct command_execution_t **execution);
 
+/**
+ * @brief Like commands_make_exec, but without opening the redirection files.
+ * Use this for plans that are copied before they are executed.
+ *
+ * @param command_line The command line as a string
+ * @param tokens The parsed tokens based on the command line string
+ * @param execution Pointer to execution variable. Used to output the result of this call.
+ * @return int - 0 if success, non-zero otherwise
+ */
+int commands_make_plan(char *command_line, struct command_tokens_t *tokens, struct command_execution_t **execution);
+
+/**
+ * @brief Check if any part of the execution has a here-document, whose body
+ * has to be set in in_data before the redirections are opened
+ *
+ * @param execution The execution
+ * @return bool - If any part has a here-document
+ */
+bool commands_has_heredoc(struct command_execution_t *execution);
+
+/**
+ * @brief Open the redirection files of every part of the given execution,
+ * and the memfds holding here-documents and here-strings. If any of them
+ * fails, the ones already opened are closed again.
+ *
+ * @param execution The execution
+ * @return int - 0 if success, non-zero otherwise with errno set
+ */
+int commands_open_redirects(struct command_execution_t *execution);
+
+/**
+ * @brief Copy the plan of the given execution, meaning the command line,
+ * arguments, redirection targets and background flag, into a new arena.
+ * Per-run state such as file descriptors and PIDs is not copied, and no
+ * redirection files are opened.
+ *
+ * @param source The execution to copy
+ * @param execution Output pointer for the copy, which owns its own arena
+ * @return int - 0 if success, non-zero otherwise
+ */
+int commands_copy_plan(struct command_execution_t *source, struct command_execution_t **execution);
+
+/**
+ * @brief Like commands_copy_plan, but every "{}" in the command line, the
+ * arguments and the redirection targets is replaced by the given item
+ *
+ * @param source The execution to copy
+ * @param item The text to replace "{}" with, or NULL to copy as is
+ * @param execution Output pointer for the copy, which owns its own arena
+ * @return int - 0 if success, non-zero otherwise
+ */
+int commands_instantiate(struct command_execution_t *source, const char *item,
+                         struct command_execution_t **execution);
+
+/**
+ * @brief Free a command execution that was never executed, closing any
+ * redirection files opened for it
+ *
+ * @param execution The command to discard
+ */
+void commands_discard(struct command_execution_t *execution);
+
 /**
  * @brief Execute the given command
  *
@@ -89,23 +264,135 @@ int commands_make_exec(char *command_line, struct command_tokens_t *tokens, stru
 void commands_execute(struct command_execution_t *execution);
 
 /**
- * @brief The amount of processes running in the background
+ * @brief Select how processes are launched. Defaults to COMMANDS_SPAWN_POSIX.
+ *
+ * @param backend COMMANDS_SPAWN_FORK or COMMANDS_SPAWN_POSIX
+ */
+void commands_set_spawn_backend(int backend);
+
+/**
+ * @brief Parse a size in bytes, optionally with a K, M or G suffix (binary)
+ *
+ * @param text The text to parse, e.g. "64K"
+ * @param size Output pointer for the size
+ * @return int - 0 if success, non-zero otherwise
+ */
+int commands_parse_size(const char *text, size_t *size);
+
+/**
+ * @brief Set the capacity of the pipes created between parts of a command
+ * line, unless the command line sets its own. Sizes above
+ * /proc/sys/fs/pipe-max-size are capped at that limit.
+ *
+ * @param size The capacity in bytes, 0 for the kernel default (64 KiB)
+ */
+void commands_set_pipe_size(size_t size);
+
+/**
+ * @brief Get the capacity set with commands_set_pipe_size
+ *
+ * @return size_t - The capacity in bytes, 0 for the kernel default
+ */
+size_t commands_get_pipe_size();
+
+/**
+ * @brief Get the largest pipe capacity that can be set
+ *
+ * @return size_t - The value of /proc/sys/fs/pipe-max-size
+ */
+size_t commands_get_pipe_max_size();
+
+/**
+ * @brief Select if parts that are a pure copy, e.g. "cat big.log", are run by
+ * the in-shell data mover instead of exec'ing cat. Enabled by default.
  *
- * @return size_t - The amount of processes running in the background
+ * @param enabled If the data mover should be used
  */
-size_t commands_get_running_count();
+void commands_set_copy_fastpath(bool enabled);
 
 /**
- * @brief Get information about a running command
+ * @brief Select if the exit status of a pipeline is that of the last part
+ * (the default), or that of the last part that failed, like "set -o pipefail"
+ * in other shells
  *
- * @param index The index of the running command
- * @return struct command_execution_t* - Information about running command
+ * @param enabled If the status of any failed part should be used
  */
-struct command_execution_t *commands_get_running(size_t index);
+void commands_set_pipefail(bool enabled);
 
 /**
- * @brief Look for any running background jobs, and clean up zombie processes
+ * @brief Check if the pipefail option is enabled
+ *
+ * @return bool - If the status of any failed part is used
+ */
+bool commands_get_pipefail();
+
+/**
+ * @brief Combine the wait statuses of every part of a completed command line
+ * into the status of the whole line, taking the pipefail option into account
+ *
+ * @param execution The completed command line
+ * @return int - The combined wait status
+ */
+int commands_exit_status(struct command_execution_t *execution);
+
+/**
+ * @brief The exit status of the last foreground command line that completed,
+ * like $? in sh. A command killed by a signal gives 128 plus the signal
+ * number, and starting a background job gives 0.
+ *
+ * @return int - The exit status, 0 before any command line completed
+ */
+int commands_last_status();
+
+/**
+ * @brief Set the exit status of the last command line, e.g. for one that
+ * could not be parsed and thus never ran
+ *
+ * @param status The exit status
+ */
+void commands_set_last_status(int status);
+
+/**
+ * @brief Start delivering SIGCHLD through a file descriptor, so that the
+ * caller can poll() for finished background jobs instead of checking once
+ * per command line. SIGCHLD is blocked in the shell, but not in children.
+ *
+ * @return int - A non-blocking file descriptor that becomes readable when a
+ * child exits, or -1 on failure
+ */
+int commands_watch_children();
+
+/**
+ * @brief Look for any running background jobs, and clean up zombie processes.
+ * Reports every job that has completed.
+ *
+ * @return size_t - The amount of background jobs that completed
+ */
+size_t commands_cleanup_running();
+
+/**
+ * @brief Wait for all running background jobs to complete
+ */
+void commands_wait_running();
+
+/**
+ * @brief Wait until at most limit command lines of the given batch are still
+ * running. Other background jobs that complete meanwhile are reported as usual.
+ *
+ * @param batch The batch
+ * @param limit The amount of command lines that may keep running
+ * @return int - 0 if success, non-zero if the wait was interrupted, e.g. by
+ * CTRL + C
+ */
+int commands_wait_batch(struct command_batch_t *batch, size_t limit);
+
+/**
+ * @brief Stop accounting the still running command lines of the given batch
+ * in it, leaving them as regular background jobs. Must be called before the
+ * batch goes out of scope.
+ *
+ * @param batch The batch
  */
-void commands_cleanup_running();
+void commands_detach_batch(struct command_batch_t *batch);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "cwd.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static char *CWD = NULL;
+// Identity of the directory the cached path referred to when it was retrieved
+static dev_t CWD_DEV;
+static ino_t CWD_INO;
+static time_t CWD_CHECKED;
+
+int cwd_refresh() {
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        return 1;
+    }
+
+    struct stat info;
+    if (stat(cwd, &info) == -1) {
+        free(cwd);
+        return 2;
+    }
+
+    free(CWD);
+    CWD = cwd;
+    CWD_DEV = info.st_dev;
+    CWD_INO = info.st_ino;
+    CWD_CHECKED = time(NULL);
+    return 0;
+}
+
+const char *cwd_get() {
+    return CWD;
+}
+
+int cwd_revalidate() {
+    if (CWD == NULL) {
+        return cwd_refresh();
+    }
+
+    time_t now = time(NULL);
+    if (now - CWD_CHECKED < CWD_REVALIDATE_INTERVAL) {
+        return 0;
+    }
+
+    CWD_CHECKED = now;
+
+    struct stat info;
+    if (stat(CWD, &info) == 0 && info.st_dev == CWD_DEV && info.st_ino == CWD_INO) {
+        return 0;  // Still valid
+    }
+
+    return cwd_refresh();
+}
@@ -0,0 +1,39 @@
+#ifndef __CWD_H__
+#define __CWD_H__
+
+/*
+ * Keeps track of the current working directory of the shell, so that
+ * rendering the prompt does not require a getcwd() call every time
+ */
+
+// Minimum amount of seconds between each revalidation of the cached path
+#define CWD_REVALIDATE_INTERVAL 5
+
+/**
+ * @brief Retrieve and cache the current working directory. Should be called
+ * once at startup, and after every successful chdir
+ *
+ * @return int - 0 if success, non-zero otherwise
+ */
+int cwd_refresh();
+
+/**
+ * @brief Get the cached current working directory. This does not perform any
+ * system calls.
+ *
+ * @return const char* - The current working directory, NULL if cwd_refresh
+ * has never succeeded
+ */
+const char *cwd_get();
+
+/**
+ * @brief Check that the cached path still refers to the working directory, e.g.
+ * that none of its parents have been renamed. This is a single stat() call
+ * and is only done if CWD_REVALIDATE_INTERVAL seconds have passed since the
+ * last check. The cache is refreshed if it is found to be stale.
+ *
+ * @return int - 0 if success, non-zero otherwise
+ */
+int cwd_revalidate();
+
+#endif
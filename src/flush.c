@@ -1,3 +1,7 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -5,99 +9,350 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "arena.h"
 #include "commands.h"
+#include "cwd.h"
+#include "history.h"
+#include "input.h"
+#include "plancache.h"
+#include "stats.h"
 #include "tokenizer.h"
-
-#define NEW_LINE '\n'
+#include "trace.h"
 
 volatile sig_atomic_t kill_line_flag;
 bool shutdown_flag = false;
 
-static void prompt() {
-    char *cwd = getcwd(NULL, 0);
-    if (cwd == NULL) {
-        fprintf(stderr, "Unable to retrieve current working directory!\n");
-        exit(EXIT_FAILURE);
+// Buffer size used when reading scripts. Since nobody is typing, we can
+// read much larger chunks at a time
+#define SCRIPT_BUFFER_SIZE (1024 * 1024)
+
+static struct input_t INPUT;
+
+// Readable when a child has exited, or -1 if SIGCHLD could not be watched
+static int CHILD_FD = -1;
+
+// Initial size of the buffer for the body of a here-document, it grows
+// geometrically after that
+#define HEREDOC_INITIAL_CAPACITY 4096
+
+// Name of the history file in the home directory
+#define HISTORY_FILE ".flush_history"
+
+// Reads the line after the current command line. This is where the bodies of
+// here-documents come from, so it depends on where the commands come from
+static int (*NEXT_LINE)(char **line, size_t *length) = NULL;
+
+// Whatever is left of the string given with -c
+static char *STRING_REST = NULL;
+
+static int string_next_line(char **line, size_t *length) {
+    if (STRING_REST == NULL) {
+        return INPUT_EOF;
     }
 
-    ssize_t data = 0, allocated = 128;
-    char *buf = malloc(allocated);
-    if (buf == NULL) {
-        fprintf(stderr, "Failed to allocate memory to input buffer!");
-        exit(EXIT_FAILURE);
+    char *newline = strchr(STRING_REST, '\n');
+    *line = STRING_REST;
+    if (newline == NULL) {
+        *length = strlen(STRING_REST);
+        STRING_REST = NULL;
+        return INPUT_LINE;
     }
 
-    memset(buf, 0, allocated);
+    *newline = '\0';
+    *length = newline - STRING_REST;
+    STRING_REST = newline + 1;
+    return INPUT_LINE;
+}
+
+static int input_next_line(char **line, size_t *length) {
+    return input_read_line(&INPUT, line, length);
+}
 
-    fprintf(stdout, "%s: ", cwd);
+static int prompt_next_line(char **line, size_t *length) {
+    fprintf(stdout, "> ");
     fflush(stdout);
 
-    char last_char;
-    ssize_t res;
-
-    // We only read 1 byte at a time to properly handly CTRL + D processing
-    while ((res = read(STDIN_FILENO, buf + data, 1)) >= 0) {
-        // This only happens when the user enters CTRL + D, which gives EOF
-        if (res == 0) {
-            fprintf(stdout, "\nGood bye!\n");
-            free(cwd);
-            free(buf);
-            shutdown_flag = true;
-            return;
+    int res = input_read_line(&INPUT, line, length);
+    if (res == INPUT_INTERRUPTED && kill_line_flag) {
+        printf("\n");
+        input_discard(&INPUT);
+    }
+
+    return res;
+}
+
+// Reads lines into the body of the here-document of the given part, until a
+// line equal to the delimiter. Returns non-zero if the command line should be
+// cancelled
+static int read_heredoc(struct command_execution_t *execution, struct command_part_t *part) {
+    size_t capacity = HEREDOC_INITIAL_CAPACITY, delimiter = strlen(part->heredoc), length, grown;
+    char *line, *data;
+    int res;
+
+    part->in_length = 0;
+    part->in_data = arena_alloc(execution->arena, capacity);
+    if (part->in_data == NULL) {
+        return 1;
+    }
+
+    while (true) {
+        res = NEXT_LINE(&line, &length);
+        if (res == INPUT_INTERRUPTED) {
+            if (kill_line_flag) {
+                return 1;
+            }
+
+            continue;
         }
 
-        data += res;
-        last_char = buf[data - 1];
+        if (res == INPUT_ERROR) {
+            return 1;
+        }
 
-        if (kill_line_flag) {
-            kill_line_flag = 0;
-            printf("\n");
+        // Like other shells, run the command with what was read so far
+        if (res == INPUT_EOF) {
+            fprintf(stderr, "Here-document ended by end of input, wanted \"%s\"\n", part->heredoc);
+            return 0;
+        }
 
-            free(cwd);
-            free(buf);
-            // Start next prompt
-            return;
+        if (length == delimiter && !memcmp(line, part->heredoc, length)) {
+            return 0;
         }
 
-        if (last_char == NEW_LINE) {
-            // Input complete
-            buf[data - 1] = '\0';
-            break;
+        if (part->in_length + length + 1 > capacity) {
+            for (grown = capacity * 2; part->in_length + length + 1 > grown; grown *= 2) {
+            }
+
+            data = arena_realloc(execution->arena, part->in_data, capacity, grown);
+            if (data == NULL) {
+                return 1;
+            }
+
+            part->in_data = data;
+            capacity = grown;
         }
 
-        if (allocated - data < 32) {
-            allocated += 64;
-            buf = realloc(buf, allocated);
-            if (buf == NULL) {
-                fprintf(stderr, "Failed to allocate memory to input buffer!");
-                exit(EXIT_FAILURE);
+        memcpy(part->in_data + part->in_length, line, length);
+        part->in_length += length;
+        part->in_data[part->in_length++] = '\n';
+    }
+}
+
+// Commands inherit the stdin the shell may be reading command lines from.
+// Before the first part can read from it, anything read past the current
+// line is handed back
+static void share_input(struct command_execution_t *execution) {
+    if (execution->parts[0].in < 0) {
+        input_sync(&INPUT);
+    }
+}
+
+// Parses and executes a single command line. Returns its exit status, or
+// EXIT_FAILURE if it could not be run
+static int execute_line(char *line, size_t length) {
+    int res;
+    struct command_execution_t *execution;
+
+    // Repeated command lines do not need to be parsed again
+    long parse_start = stats_now(), phase = trace_begin();
+    res = plancache_get(line, length, &execution);
+    trace_end("cache", phase, NULL);
+    if (res == PLANCACHE_HIT) {
+        stats_record(STATS_PARSE, stats_now() - parse_start);
+        history_add(line, length);
+        share_input(execution);
+        commands_execute(execution);
+        return commands_last_status();
+    }
+
+    if (res == PLANCACHE_ERROR) {
+        fprintf(stderr, "Failed to allocate memory for [%s]\n", line);
+        return EXIT_FAILURE;
+    }
+
+    if (res == PLANCACHE_REDIRECT_ERROR) {
+        fprintf(stderr, "Failed to open redirection for [%s]: %s\n", line, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // Every allocation for this command line is made from this arena. It is
+    // handed over to the execution, which frees it once the command completes
+    struct arena_t *arena = arena_create();
+    if (arena == NULL) {
+        fprintf(stderr, "Failed to allocate memory for [%s]\n", line);
+        return EXIT_FAILURE;
+    }
+
+    struct command_tokens_t tokens;
+    phase = trace_begin();
+    res = tokens_read(&tokens, line, length, arena);
+    trace_end("tokenize", phase, NULL);
+
+    if (res) {
+        fprintf(stderr, "Failed to parse tokens for [%s], error: %d\n", line,
+                res);
+        arena_free(arena);
+        return EXIT_FAILURE;
+    }
+
+    phase = trace_begin();
+    res = commands_make_plan(line, &tokens, &execution);
+    trace_end("plan", phase, NULL);
+    stats_record(STATS_PARSE, stats_now() - parse_start);
+
+    if (res) {
+        fprintf(stderr, "Failed to make target for [%s], error: %d\n",
+                line, res);
+        arena_free(arena);
+        return EXIT_FAILURE;
+    }
+
+    // Only command lines that could be parsed are worth recalling
+    history_add(line, length);
+
+    // The bodies follow the command line, so reading them may move the input
+    // buffer. Only the copy of the line in the execution is used after this
+    if (commands_has_heredoc(execution)) {
+        for (size_t i = 0; i < execution->part_count; i++) {
+            if (execution->parts[i].heredoc != NULL && read_heredoc(execution, &execution->parts[i])) {
+                arena_free(arena);
+                return EXIT_FAILURE;
             }
         }
     }
 
-    if (strlen(buf) != 0) {
-        int res;
-        struct command_tokens_t tokens;
-        res = tokens_read(&tokens, buf, data);
+    phase = trace_begin();
+    res = commands_open_redirects(execution);
+    trace_end("redirect", phase, NULL);
 
-        if (res) {
-            fprintf(stderr, "Failed to parse tokens for [%s], error: %d\n", buf,
-                    res);
-        } else {
-            struct command_execution_t *execution;
-            res = commands_make_exec(buf, &tokens, &execution);
-
-            if (res) {
-                fprintf(stderr, "Failed to make target for [%s], error: %d\n",
-                        buf, res);
-            } else {
-                commands_execute(execution);
+    if (res) {
+        fprintf(stderr, "Failed to open redirection for [%s]: %s\n", execution->command_line,
+                strerror(errno));
+        arena_free(arena);
+        return EXIT_FAILURE;
+    }
+
+    // Failing to cache the plan is not a problem, it is just parsed again
+    plancache_put(execution);
+    share_input(execution);
+    commands_execute(execution);
+    return commands_last_status();
+}
+
+// Lines that could not be run count as failed, e.g. for "exit"
+static void run_line(char *line, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    if (!trace_enabled) {
+        commands_set_last_status(execute_line(line, length));
+        return;
+    }
+
+    // The line may be overwritten by reading here-documents, and the trace
+    // may be stopped by the line itself
+    char detail[128];
+    snprintf(detail, sizeof(detail), "%.*s", (int)length, line);
+    long start = trace_now();
+    commands_set_last_status(execute_line(line, length));
+    trace_end("line", start, detail);
+}
+
+static void print_prompt() {
+    if (cwd_revalidate()) {
+        fprintf(stderr, "Unable to retrieve current working directory!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stdout, "%s: ", cwd_get());
+    fflush(stdout);
+}
+
+// Reports background jobs as soon as they complete, instead of when the next
+// command line is entered. The prompt is cleared first and drawn again after
+static void report_children() {
+    fprintf(stdout, "\r\033[K");
+    commands_cleanup_running();
+    print_prompt();
+}
+
+// Waits until a complete line can be read without blocking, handling child
+// exits while waiting. Returns INPUT_LINE when input_read_line can be called
+static int wait_for_line() {
+    // A negative fd is ignored by poll, so this also works without a signalfd
+    struct pollfd fds[2] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = CHILD_FD, .events = POLLIN},
+    };
+    int res;
+
+    while (!input_ready(&INPUT)) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno != EINTR) {
+                return INPUT_ERROR;
+            }
+
+            if (kill_line_flag) {
+                return INPUT_INTERRUPTED;
+            }
+
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            report_children();
+        }
+
+        if (fds[0].revents) {
+            res = input_fill(&INPUT);
+            if (res == INPUT_ERROR || (res == INPUT_INTERRUPTED && kill_line_flag)) {
+                return res;
             }
         }
     }
 
-    free(cwd);
-    free(buf);
+    return INPUT_LINE;
+}
+
+static void prompt() {
+    // A CTRL + C while a command was running only applies to that command
+    kill_line_flag = 0;
+    print_prompt();
+
+    char *buf;
+    size_t data;
+    int res = wait_for_line();
+
+    if (res == INPUT_INTERRUPTED) {
+        kill_line_flag = 0;
+        printf("\n");
+
+        // Throw away whatever was typed so far
+        input_discard(&INPUT);
+        // Start next prompt
+        return;
+    }
+
+    if (res == INPUT_LINE) {
+        long phase = trace_begin();
+        res = input_read_line(&INPUT, &buf, &data);
+        trace_end("read", phase, NULL);
+    }
+
+    // This only happens when the user enters CTRL + D, which gives EOF
+    if (res == INPUT_EOF) {
+        fprintf(stdout, "\nGood bye!\n");
+        shutdown_flag = true;
+        return;
+    }
+
+    if (res == INPUT_ERROR) {
+        fprintf(stderr, "Failed to read from input!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run_line(buf, data);
 }
 
 void __shutdown_sig_handler(int sig) {
@@ -106,7 +361,86 @@ void __shutdown_sig_handler(int sig) {
     kill_line_flag = 1;
 }
 
-int main(int argc, char **argv) {
+// Runs every line in the given string, e.g. from "flush -c "ls -l"".
+// Returns the exit status of the last line
+static int run_string(char *input) {
+    char *line;
+    size_t length;
+
+    STRING_REST = input;
+    NEXT_LINE = string_next_line;
+    while (string_next_line(&line, &length) == INPUT_LINE) {
+        run_line(line, length);
+        commands_cleanup_running();
+    }
+
+    return commands_last_status();
+}
+
+// Runs every line read from the given file descriptor without rendering any
+// prompt. Used for scripts and when stdin is not a terminal. If shared, the
+// commands read from the same file descriptor. Returns the exit status of the
+// last line
+static int run_input(int fd, bool shared) {
+    if (input_init(&INPUT, fd, SCRIPT_BUFFER_SIZE)) {
+        fprintf(stderr, "Failed to allocate memory to input buffer!");
+        exit(EXIT_FAILURE);
+    }
+
+    // E.g. "printf 'cat\nhello\n' | flush", where cat reads the second line
+    if (shared) {
+        input_share(&INPUT);
+    }
+
+    char *line;
+    size_t length;
+    int res;
+    long phase = trace_begin();
+    NEXT_LINE = input_next_line;
+    while ((res = input_read_line(&INPUT, &line, &length)) != INPUT_EOF) {
+        trace_end("read", phase, NULL);
+        if (res == INPUT_INTERRUPTED) {
+            phase = trace_begin();
+            continue;
+        }
+
+        if (res == INPUT_ERROR) {
+            fprintf(stderr, "Failed to read from input!\n");
+            exit(EXIT_FAILURE);
+        }
+
+        run_line(line, length);
+        commands_cleanup_running();
+        phase = trace_begin();
+    }
+
+    input_finish(&INPUT);
+    return commands_last_status();
+}
+
+// Runs the command lines piped or redirected into the shell. These are read
+// ahead in large chunks, so the commands get /dev/null as stdin instead.
+// With FLUSH_STDIN=shared, the commands read the rest of stdin like in sh,
+// which means never reading past the current line
+static int run_stdin() {
+    char *mode = getenv("FLUSH_STDIN");
+    if (mode != NULL && !strcmp(mode, "shared")) {
+        return run_input(STDIN_FILENO, true);
+    }
+
+    int fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0), null = open("/dev/null", O_RDONLY);
+    if (fd == -1 || null == -1 || dup2(null, STDIN_FILENO) == -1) {
+        fprintf(stderr, "Unable to replace stdin of the commands: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    close(null);
+    int status = run_input(fd, false);
+    close(fd);
+    return status;
+}
+
+static void run_interactive() {
     // This makes it so that CTRL + C just terminates the current
     // command being entered, essentially cancelling the current
     // command before it is even ran
@@ -117,8 +451,98 @@ int main(int argc, char **argv) {
 
     sigaction(SIGINT, &shutdown_sig_action, NULL);
 
+    if (input_init(&INPUT, STDIN_FILENO, INPUT_BUFFER_SIZE)) {
+        fprintf(stderr, "Failed to allocate memory to input buffer!");
+        exit(EXIT_FAILURE);
+    }
+
+    // Finished background jobs are picked up by the poll() in wait_for_line.
+    // If this fails we fall back to checking once per command line
+    CHILD_FD = commands_watch_children();
+    NEXT_LINE = prompt_next_line;
+
+    // Only interactive command lines are recorded, FLUSH_HISTORY= turns it off
+    char *history = getenv("FLUSH_HISTORY"), *home = getenv("HOME"), path[PATH_MAX];
+    if (history == NULL && home != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE);
+        history = path;
+    }
+
+    if (history != NULL && history[0] != '\0' && history_open(history)) {
+        fprintf(stderr, "Unable to open history file \"%s\"\n", history);
+    }
+
     while (!shutdown_flag) {
         prompt();
         commands_cleanup_running();
     }
+
+    input_finish(&INPUT);
+}
+
+int main(int argc, char **argv) {
+    // FLUSH_SPAWN=fork uses fork() + exec instead of posix_spawnp()
+    char *spawn = getenv("FLUSH_SPAWN");
+    if (spawn != NULL && !strcmp(spawn, "fork")) {
+        commands_set_spawn_backend(COMMANDS_SPAWN_FORK);
+    }
+
+    // FLUSH_PIPE_SIZE=1M sets the capacity of the pipes between parts
+    char *pipe_size = getenv("FLUSH_PIPE_SIZE");
+    size_t size;
+    if (pipe_size != NULL) {
+        if (commands_parse_size(pipe_size, &size)) {
+            fprintf(stderr, "Ignoring invalid FLUSH_PIPE_SIZE \"%s\"\n", pipe_size);
+        } else {
+            commands_set_pipe_size(size);
+        }
+    }
+
+    // FLUSH_COPY=exec runs cat even for parts the data mover could handle
+    char *copy = getenv("FLUSH_COPY");
+    if (copy != NULL && !strcmp(copy, "exec")) {
+        commands_set_copy_fastpath(false);
+    }
+
+    // FLUSH_TRACE=trace.json records a trace of every command line
+    char *trace = getenv("FLUSH_TRACE");
+    if (trace != NULL && trace[0] != '\0' && trace_start(trace)) {
+        fprintf(stderr, "Unable to open trace file \"%s\"\n", trace);
+    }
+
+    // Only the interactive prompt needs this to succeed, which is checked on
+    // every prompt via cwd_revalidate()
+    cwd_refresh();
+
+    // flush -c "command"
+    if (argc > 1 && !strcmp(argv[1], "-c")) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s [-c command | script]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        return run_string(argv[2]);
+    }
+
+    // flush script.sh
+    if (argc > 1) {
+        int fd = open(argv[1], O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "Unable to open script \"%s\"\n", argv[1]);
+            exit(EXIT_FAILURE);
+        }
+
+        int status = run_input(fd, false);
+        close(fd);
+        return status;
+    }
+
+    // Nobody is at the terminal, e.g. "generate_commands | flush", so there
+    // is no point in rendering a prompt for every line
+    if (!isatty(STDIN_FILENO)) {
+        return run_stdin();
+    }
+
+    run_interactive();
+    return EXIT_SUCCESS;
 }
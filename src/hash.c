@@ -0,0 +1,29 @@
+#include "hash.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+uint64_t hash_bytes(const char *data, size_t length) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+uint64_t hash_string(const char *string) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (; *string; string++) {
+        hash ^= (unsigned char)*string;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+size_t hash_slot(uint64_t key, size_t capacity) {
+    // The top bits of the product mix every bit of the key
+    return (key * 0x9e3779b97f4a7c15ULL >> 32) & (capacity - 1);
+}
@@ -0,0 +1,43 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hash functions shared by the caches and tables of the shell. FNV-1a is
+ * used for strings, which are short and hashed once per lookup. Integer keys
+ * are spread over power of two tables with Fibonacci hashing, since keys such
+ * as PIDs or trigrams of text are far from uniform in their low bits.
+ */
+
+/**
+ * @brief Hash the given bytes with 64 bit FNV-1a
+ *
+ * @param data The bytes to hash
+ * @param length The amount of bytes
+ * @return uint64_t - The hash
+ */
+uint64_t hash_bytes(const char *data, size_t length);
+
+/**
+ * @brief Hash a NUL terminated string with 64 bit FNV-1a. Gives the same
+ * hash as hash_bytes() over the characters of the string.
+ *
+ * @param string The string to hash
+ * @return uint64_t - The hash
+ */
+uint64_t hash_string(const char *string);
+
+/**
+ * @brief Map an integer key to a slot of a table, using Fibonacci hashing.
+ * Tables probed linearly from this slot are kept at most half full, so the
+ * probes stay short.
+ *
+ * @param key The key
+ * @param capacity The amount of slots of the table, a power of two
+ * @return size_t - The slot, below capacity
+ */
+size_t hash_slot(uint64_t key, size_t capacity);
+
+#endif
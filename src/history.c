@@ -0,0 +1,520 @@
+#define _GNU_SOURCE
+#include "history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "hash.h"
+
+// Initial amount of entries, lines and trigrams. Everything grows
+// geometrically after that
+#define INITIAL_CAPACITY 1024
+#define POSTINGS_INITIAL_CAPACITY 8
+// Bytes a varint of 32 bits takes at most
+#define VARINT_MAX_SIZE 5
+
+// A distinct command line
+struct line_t {
+    uint64_t hash;
+    // Offset of the text of its first entry in the file
+    uint64_t offset;
+    uint32_t length;
+    // Index of its most recent entry
+    uint32_t last;
+};
+
+// The lines containing a trigram, in increasing order. Stored as varints of
+// the difference to the previous line, which mostly fit in one or two bytes.
+// Slots of the trigram table without any lines are empty
+struct posting_t {
+    uint32_t trigram;
+    uint32_t count;
+    uint32_t last;
+    uint32_t size;
+    uint32_t capacity;
+    uint8_t *lines;
+};
+
+static int HISTORY_FD = -1;
+static char *MAP = NULL;
+static size_t MAP_SIZE = 0;
+// Every entry before this offset in the file has been indexed or skipped
+static size_t INDEXED = 0;
+// The amount of entries in the file before the first indexed one
+static size_t SKIPPED = 0;
+
+// The line of every entry, in the order they were added
+static uint32_t *ENTRIES = NULL;
+static size_t ENTRY_COUNT = 0;
+static size_t ENTRY_CAPACITY = 0;
+
+static struct line_t *LINES = NULL;
+static size_t LINE_COUNT = 0;
+static size_t LINE_CAPACITY = 0;
+
+// Open addressing with linear probing of line index + 1, 0 marks an empty
+// slot. Capacity is always a power of two
+static uint32_t *LINE_SLOTS = NULL;
+static size_t LINE_SLOTS_CAPACITY = 0;
+
+// Open addressing with linear probing, capacity is always a power of two
+static struct posting_t *TRIGRAMS = NULL;
+static size_t TRIGRAM_COUNT = 0;
+static size_t TRIGRAM_CAPACITY = 0;
+
+static uint32_t trigram_at(const char *text) {
+    return (uint32_t)(unsigned char)text[0] << 16 | (uint32_t)(unsigned char)text[1] << 8 |
+           (unsigned char)text[2];
+}
+
+static int grow_line_slots() {
+    size_t capacity = LINE_SLOTS_CAPACITY ? LINE_SLOTS_CAPACITY * 2 : INITIAL_CAPACITY;
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        return 1;
+    }
+
+    size_t slot;
+    for (size_t i = 0; i < LINE_COUNT; i++) {
+        slot = LINES[i].hash & (capacity - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        slots[slot] = i + 1;
+    }
+
+    free(LINE_SLOTS);
+    LINE_SLOTS = slots;
+    LINE_SLOTS_CAPACITY = capacity;
+    return 0;
+}
+
+static int grow_trigrams() {
+    size_t capacity = TRIGRAM_CAPACITY ? TRIGRAM_CAPACITY * 2 : INITIAL_CAPACITY;
+    struct posting_t *trigrams = calloc(capacity, sizeof(struct posting_t));
+    if (trigrams == NULL) {
+        return 1;
+    }
+
+    size_t slot;
+    for (size_t i = 0; i < TRIGRAM_CAPACITY; i++) {
+        if (TRIGRAMS[i].lines == NULL) {
+            continue;
+        }
+
+        slot = hash_slot(TRIGRAMS[i].trigram, capacity);
+        while (trigrams[slot].lines != NULL) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        trigrams[slot] = TRIGRAMS[i];
+    }
+
+    free(TRIGRAMS);
+    TRIGRAMS = trigrams;
+    TRIGRAM_CAPACITY = capacity;
+    return 0;
+}
+
+// Returns the lines containing the trigram, NULL if there are none
+static struct posting_t *find_trigram(uint32_t trigram) {
+    if (TRIGRAM_CAPACITY == 0) {
+        return NULL;
+    }
+
+    size_t slot = hash_slot(trigram, TRIGRAM_CAPACITY);
+    while (TRIGRAMS[slot].lines != NULL) {
+        if (TRIGRAMS[slot].trigram == trigram) {
+            return &TRIGRAMS[slot];
+        }
+
+        slot = (slot + 1) & (TRIGRAM_CAPACITY - 1);
+    }
+
+    return NULL;
+}
+
+static int add_posting(uint32_t trigram, uint32_t line) {
+    struct posting_t *posting = find_trigram(trigram);
+    if (posting == NULL) {
+        // At most half full, like the line slots
+        if ((TRIGRAM_COUNT + 1) * 2 > TRIGRAM_CAPACITY && grow_trigrams()) {
+            return 1;
+        }
+
+        size_t slot = hash_slot(trigram, TRIGRAM_CAPACITY);
+        while (TRIGRAMS[slot].lines != NULL) {
+            slot = (slot + 1) & (TRIGRAM_CAPACITY - 1);
+        }
+
+        posting = &TRIGRAMS[slot];
+        posting->lines = malloc(POSTINGS_INITIAL_CAPACITY);
+        if (posting->lines == NULL) {
+            return 1;
+        }
+
+        posting->trigram = trigram;
+        posting->count = 0;
+        posting->last = 0;
+        posting->size = 0;
+        posting->capacity = POSTINGS_INITIAL_CAPACITY;
+        TRIGRAM_COUNT++;
+    }
+
+    // Lines are indexed in increasing order, so a trigram occurring more
+    // than once in a line is only added once
+    if (posting->count > 0 && posting->last == line) {
+        return 0;
+    }
+
+    if (posting->size + VARINT_MAX_SIZE > posting->capacity) {
+        uint8_t *reallocated = realloc(posting->lines, posting->capacity * 2);
+        if (reallocated == NULL) {
+            return 1;
+        }
+
+        posting->lines = reallocated;
+        posting->capacity *= 2;
+    }
+
+    uint32_t delta = line - posting->last;
+    while (delta >= 0x80) {
+        posting->lines[posting->size++] = delta | 0x80;
+        delta >>= 7;
+    }
+
+    posting->lines[posting->size++] = delta;
+    posting->last = line;
+    posting->count++;
+    return 0;
+}
+
+// Decodes the next line of a posting list, starting at the given byte
+static uint32_t next_posting(struct posting_t *posting, size_t *position, uint32_t previous) {
+    uint32_t delta = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = posting->lines[(*position)++];
+        delta |= (uint32_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return previous + delta;
+}
+
+// Returns the index of the line with the given text, adding it if it is new.
+// Returns -1 if memory could not be allocated
+static int64_t find_line(uint64_t offset, uint32_t length) {
+    const char *text = MAP + offset;
+    uint64_t hash = hash_bytes(text, length);
+
+    // At most half full, see hash_slot()
+    if ((LINE_COUNT + 1) * 2 > LINE_SLOTS_CAPACITY && grow_line_slots()) {
+        return -1;
+    }
+
+    size_t slot = hash & (LINE_SLOTS_CAPACITY - 1);
+    struct line_t *line;
+    while (LINE_SLOTS[slot] != 0) {
+        line = &LINES[LINE_SLOTS[slot] - 1];
+        if (line->hash == hash && line->length == length && !memcmp(MAP + line->offset, text, length)) {
+            return LINE_SLOTS[slot] - 1;
+        }
+
+        slot = (slot + 1) & (LINE_SLOTS_CAPACITY - 1);
+    }
+
+    if (LINE_COUNT == LINE_CAPACITY) {
+        size_t capacity = LINE_CAPACITY ? LINE_CAPACITY * 2 : INITIAL_CAPACITY;
+        struct line_t *reallocated = realloc(LINES, capacity * sizeof(struct line_t));
+        if (reallocated == NULL) {
+            return -1;
+        }
+
+        LINES = reallocated;
+        LINE_CAPACITY = capacity;
+    }
+
+    uint32_t index = LINE_COUNT;
+    for (uint32_t i = 0; i + 3 <= length; i++) {
+        if (add_posting(trigram_at(text + i), index)) {
+            return -1;
+        }
+    }
+
+    line = &LINES[index];
+    line->hash = hash;
+    line->offset = offset;
+    line->length = length;
+    LINE_SLOTS[slot] = index + 1;
+    LINE_COUNT++;
+    return index;
+}
+
+static int index_entry(uint64_t offset, uint32_t length) {
+    if (ENTRY_COUNT == ENTRY_CAPACITY) {
+        size_t capacity = ENTRY_CAPACITY ? ENTRY_CAPACITY * 2 : INITIAL_CAPACITY;
+        uint32_t *reallocated = realloc(ENTRIES, capacity * sizeof(uint32_t));
+        if (reallocated == NULL) {
+            return 1;
+        }
+
+        ENTRIES = reallocated;
+        ENTRY_CAPACITY = capacity;
+    }
+
+    int64_t line = find_line(offset, length);
+    if (line == -1) {
+        return 1;
+    }
+
+    LINES[line].last = ENTRY_COUNT;
+    ENTRIES[ENTRY_COUNT++] = line;
+    return 0;
+}
+
+// Returns the length of the entry at the given offset, or 0 if there is no
+// complete entry there. Either the entry is still being written, or the file
+// is damaged, e.g. by a short write on a full disk
+static uint32_t entry_length(size_t offset) {
+    uint32_t length;
+    if (offset + sizeof(uint32_t) > MAP_SIZE) {
+        return 0;
+    }
+
+    memcpy(&length, MAP + offset, sizeof(uint32_t));
+    if (length > HISTORY_MAX_LINE || offset + sizeof(uint32_t) + length > MAP_SIZE) {
+        return 0;
+    }
+
+    return length;
+}
+
+// Skips the oldest entries after INDEXED, so that at most
+// HISTORY_MAX_INDEXED remain to be indexed
+static void skip_oldest() {
+    size_t total = 0;
+    uint32_t length;
+    for (size_t offset = INDEXED; (length = entry_length(offset)) != 0; offset += sizeof(uint32_t) + length) {
+        total++;
+    }
+
+    for (; total > HISTORY_MAX_INDEXED; total--) {
+        INDEXED += sizeof(uint32_t) + entry_length(INDEXED);
+        SKIPPED++;
+    }
+}
+
+// Drops the whole index. The file stays mapped
+static void clear_index() {
+    for (size_t i = 0; i < TRIGRAM_CAPACITY; i++) {
+        free(TRIGRAMS[i].lines);
+    }
+
+    free(TRIGRAMS);
+    free(LINE_SLOTS);
+    free(LINES);
+    free(ENTRIES);
+    TRIGRAMS = NULL;
+    LINE_SLOTS = NULL;
+    LINES = NULL;
+    ENTRIES = NULL;
+    TRIGRAM_COUNT = TRIGRAM_CAPACITY = LINE_SLOTS_CAPACITY = 0;
+    LINE_COUNT = LINE_CAPACITY = ENTRY_COUNT = ENTRY_CAPACITY = 0;
+    INDEXED = SKIPPED = 0;
+}
+
+int history_refresh() {
+    struct stat info;
+    if (HISTORY_FD < 0 || fstat(HISTORY_FD, &info)) {
+        return 1;
+    }
+
+    size_t size = info.st_size;
+    if (size > MAP_SIZE) {
+        char *map = MAP == NULL ? mmap(NULL, size, PROT_READ, MAP_SHARED, HISTORY_FD, 0)
+                                : mremap(MAP, MAP_SIZE, size, MREMAP_MAYMOVE);
+        if (map == MAP_FAILED) {
+            return 1;
+        }
+
+        MAP = map;
+        MAP_SIZE = size;
+    }
+
+    if (INDEXED == 0) {
+        if (MAP_SIZE < HISTORY_HEADER_SIZE || memcmp(MAP, HISTORY_MAGIC, HISTORY_HEADER_SIZE)) {
+            return 1;
+        }
+
+        INDEXED = HISTORY_HEADER_SIZE;
+        skip_oldest();
+    }
+
+    uint32_t length;
+    while ((length = entry_length(INDEXED)) != 0) {
+        if (index_entry(INDEXED + sizeof(uint32_t), length)) {
+            return 1;
+        }
+
+        INDEXED += sizeof(uint32_t) + length;
+    }
+
+    // Lines are never removed from the index, so once enough was appended
+    // since it was built, it is built again from the most recent entries
+    if (ENTRY_COUNT > 2 * HISTORY_MAX_INDEXED) {
+        clear_index();
+        return history_refresh();
+    }
+
+    return 0;
+}
+
+// Creates the file with its header under a temporary name, and then links it
+// to the path. Other shells never see a file without a header this way
+static int create(const char *path) {
+    char *temporary = malloc(strlen(path) + sizeof(".XXXXXX"));
+    if (temporary == NULL) {
+        return -1;
+    }
+
+    sprintf(temporary, "%s.XXXXXX", path);
+    int fd = mkstemp(temporary);
+    if (fd == -1) {
+        free(temporary);
+        return -1;
+    }
+
+    // Losing the race against another shell creating it is fine
+    int res = write(fd, HISTORY_MAGIC, HISTORY_HEADER_SIZE) != HISTORY_HEADER_SIZE ||
+              (link(temporary, path) && errno != EEXIST);
+    unlink(temporary);
+    close(fd);
+    free(temporary);
+    if (res) {
+        return -1;
+    }
+
+    return open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+}
+
+int history_open(const char *path) {
+    int fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT) {
+        fd = create(path);
+    }
+
+    if (fd == -1) {
+        return 1;
+    }
+
+    HISTORY_FD = fd;
+    return 0;
+}
+
+bool history_enabled() {
+    return HISTORY_FD >= 0;
+}
+
+void history_add(const char *line, size_t length) {
+    if (HISTORY_FD < 0 || length == 0 || length > HISTORY_MAX_LINE) {
+        return;
+    }
+
+    uint32_t prefix = length;
+    struct iovec parts[2] = {
+        {.iov_base = &prefix, .iov_len = sizeof(uint32_t)},
+        {.iov_base = (void *)line, .iov_len = length},
+    };
+
+    // A single write to a file opened with O_APPEND, so that entries of
+    // concurrent shells never interleave. Failing to record is not worth
+    // bothering the user with, and the entry is indexed by the next lookup
+    writev(HISTORY_FD, parts, 2);
+}
+
+static void print_entry(FILE *out, size_t entry, struct line_t *line) {
+    fprintf(out, "%6zu  %.*s\n", SKIPPED + entry + 1, (int)line->length, MAP + line->offset);
+}
+
+int history_print(FILE *out, size_t count) {
+    if (history_refresh()) {
+        return 1;
+    }
+
+    size_t first = count == 0 || count > ENTRY_COUNT ? 0 : ENTRY_COUNT - count;
+    for (size_t i = first; i < ENTRY_COUNT; i++) {
+        print_entry(out, i, &LINES[ENTRIES[i]]);
+    }
+
+    return 0;
+}
+
+static bool matches_term(struct line_t *line, const char *term, size_t length, bool prefix) {
+    if (prefix) {
+        return line->length >= length && !memcmp(MAP + line->offset, term, length);
+    }
+
+    return memmem(MAP + line->offset, line->length, term, length) != NULL;
+}
+
+static int compare_last(const void *a, const void *b) {
+    uint32_t x = LINES[*(const uint32_t *)a].last, y = LINES[*(const uint32_t *)b].last;
+    return (x > y) - (x < y);
+}
+
+int history_search(FILE *out, const char *term, bool prefix, size_t *matches) {
+    size_t length = strlen(term);
+    *matches = 0;
+    if (history_refresh()) {
+        return 1;
+    }
+
+    // Every matching line contains every trigram of the term, so only the
+    // lines of its rarest trigram need to be checked. Shorter terms have no
+    // trigrams, and are checked against every line
+    struct posting_t *rarest = NULL, *posting;
+    for (size_t i = 0; i + 3 <= length; i++) {
+        posting = find_trigram(trigram_at(term + i));
+        if (posting == NULL) {
+            return 0;
+        }
+
+        if (rarest == NULL || posting->count < rarest->count) {
+            rarest = posting;
+        }
+    }
+
+    size_t candidates = rarest != NULL ? rarest->count : LINE_COUNT;
+    uint32_t *found = malloc((candidates ? candidates : 1) * sizeof(uint32_t)), line;
+    if (found == NULL) {
+        return 1;
+    }
+
+    size_t position = 0;
+    line = 0;
+    for (size_t i = 0; i < candidates; i++) {
+        line = rarest != NULL ? next_posting(rarest, &position, line) : i;
+        if (matches_term(&LINES[line], term, length, prefix)) {
+            found[(*matches)++] = line;
+        }
+    }
+
+    // Lines are indexed in order of first use, but shown in order of last use
+    qsort(found, *matches, sizeof(uint32_t), compare_last);
+    for (size_t i = 0; i < *matches; i++) {
+        print_entry(out, LINES[found[i]].last, &LINES[found[i]]);
+    }
+
+    free(found);
+    return 0;
+}
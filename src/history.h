@@ -0,0 +1,87 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Persistent command history, shared by every interactive shell of a user.
+ *
+ * The file is an append-only log: an 8 byte header followed by entries of a
+ * 32 bit length and the command line, without terminator. Every entry is
+ * appended with a single write on a file opened with O_APPEND, so appending
+ * is O(1) and concurrent shells never interleave their entries.
+ *
+ * Reading maps the file into memory. The first lookup indexes the most recent
+ * HISTORY_MAX_INDEXED entries, later lookups only index what was appended
+ * since, by any shell. Older entries stay in the file, but are not listed or
+ * searched. This bounds the index to a few tens of MB. Identical
+ * command lines are indexed once, in a trigram index from every 3 byte
+ * sequence to the lines containing it. Substring and prefix searches only
+ * look at the lines containing every trigram of the term.
+ */
+
+#define HISTORY_MAGIC "FLUSHH01"
+#define HISTORY_HEADER_SIZE 8
+// Longer command lines are not recorded
+#define HISTORY_MAX_LINE 65536
+// The amount of most recent entries that are indexed
+#define HISTORY_MAX_INDEXED 500000
+
+/**
+ * @brief Open the history file, creating it if it does not exist
+ *
+ * @param path The path of the history file
+ * @return int - 0 if success, non-zero otherwise
+ */
+int history_open(const char *path);
+
+/**
+ * @brief Check if a history file is open
+ *
+ * @return bool - If history is recorded
+ */
+bool history_enabled();
+
+/**
+ * @brief Append a command line to the history. Does nothing if no history
+ * file is open.
+ *
+ * @param line The command line
+ * @param length The length of the command line
+ */
+void history_add(const char *line, size_t length);
+
+/**
+ * @brief Index whatever was appended to the history file since the last
+ * lookup. Lookups do this themselves, but calling this in the shell before
+ * forking saves every forked lookup from indexing the file on its own.
+ *
+ * @return int - 0 if success, non-zero otherwise
+ */
+int history_refresh();
+
+/**
+ * @brief Print the most recent entries, oldest first, with their number
+ *
+ * @param out Where to print
+ * @param count The amount of entries, or 0 for every entry
+ * @return int - 0 if success, non-zero otherwise
+ */
+int history_print(FILE *out, size_t count);
+
+/**
+ * @brief Print every distinct command line containing, or starting with, the
+ * given term. Lines are printed in the order they were last used, with the
+ * number of that entry.
+ *
+ * @param out Where to print
+ * @param term The term to search for
+ * @param prefix If only lines starting with the term match
+ * @param matches Output location for the amount of matching lines
+ * @return int - 0 if success, non-zero otherwise
+ */
+int history_search(FILE *out, const char *term, bool prefix, size_t *matches);
+
+#endif
@@ -0,0 +1,175 @@
+#include "input.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int input_init(struct input_t *input, int fd, size_t capacity) {
+    // We always keep one byte spare for the NUL terminator of the last line
+    if (capacity < 2) {
+        capacity = 2;
+    }
+
+    input->buffer = malloc(capacity);
+    if (input->buffer == NULL) {
+        return 1;
+    }
+
+    input->fd = fd;
+    input->capacity = capacity;
+    input->start = 0;
+    input->end = 0;
+    input->scanned = 0;
+    input->eof = false;
+    input->shared = false;
+    input->seekable = false;
+    return 0;
+}
+
+void input_share(struct input_t *input) {
+    input->shared = true;
+    input->seekable = lseek(input->fd, 0, SEEK_CUR) != -1;
+}
+
+void input_sync(struct input_t *input) {
+    if (!input->shared || !input->seekable || input->start == input->end) {
+        return;
+    }
+
+    // Only fails if the file descriptor was replaced meanwhile, in which
+    // case the buffered data is still handed out
+    if (lseek(input->fd, -(off_t)(input->end - input->start), SEEK_CUR) != -1) {
+        input_discard(input);
+        input->eof = false;
+    }
+}
+
+void input_finish(struct input_t *input) {
+    free(input->buffer);
+    input->buffer = NULL;
+    input->capacity = 0;
+    input->start = 0;
+    input->end = 0;
+    input->scanned = 0;
+}
+
+void input_discard(struct input_t *input) {
+    input->start = 0;
+    input->end = 0;
+    input->scanned = 0;
+}
+
+// Makes sure there is space for at least one more byte of data (in addition
+// to the spare byte for the NUL terminator)
+static int make_room(struct input_t *input) {
+    if (input->end + 1 < input->capacity) {
+        return 0;
+    }
+
+    // Move unconsumed data to the front before resorting to growing the buffer.
+    // This is at most one memmove per buffer worth of input
+    if (input->start > 0) {
+        size_t shift = input->start;
+        memmove(input->buffer, input->buffer + input->start, input->end - input->start);
+        input->end -= shift;
+        input->scanned -= shift;
+        input->start = 0;
+        return 0;
+    }
+
+    // A single line is larger than the buffer, grow it geometrically
+    size_t capacity = input->capacity * 2;
+    char *reallocated = realloc(input->buffer, capacity);
+    if (reallocated == NULL) {
+        return 1;
+    }
+
+    input->buffer = reallocated;
+    input->capacity = capacity;
+    return 0;
+}
+
+// Finds the next newline, only looking at bytes that have not been checked
+// before. This makes sure every byte is only scanned once, even for long lines
+static char *find_newline(struct input_t *input) {
+    char *newline = memchr(input->buffer + input->scanned, '\n', input->end - input->scanned);
+    input->scanned = newline != NULL ? (size_t)(newline - input->buffer) : input->end;
+    return newline;
+}
+
+bool input_ready(struct input_t *input) {
+    return input->eof || find_newline(input) != NULL;
+}
+
+int input_fill(struct input_t *input) {
+    if (input->eof) {
+        return INPUT_EOF;
+    }
+
+    if (make_room(input)) {
+        return INPUT_ERROR;
+    }
+
+    // Leave the last byte for the NUL terminator. Data read past the current
+    // line of a shared reader is handed back by every input_sync(), so those
+    // are read in small chunks, or byte by byte if it can not be handed back
+    size_t size = input->capacity - input->end - 1, limit = input->seekable ? INPUT_SHARED_READ_SIZE : 1;
+    if (input->shared && size > limit) {
+        size = limit;
+    }
+
+    ssize_t res = read(input->fd, input->buffer + input->end, size);
+    if (res < 0) {
+        if (errno == EINTR) {
+            return INPUT_INTERRUPTED;
+        }
+
+        return INPUT_ERROR;
+    }
+
+    // This happens when the user enters CTRL + D or the input is exhausted
+    if (res == 0) {
+        input->eof = true;
+        return INPUT_EOF;
+    }
+
+    input->end += res;
+    return INPUT_LINE;
+}
+
+int input_read_line(struct input_t *input, char **line, size_t *length) {
+    char *newline;
+    int res;
+
+    while (true) {
+        newline = find_newline(input);
+        if (newline != NULL) {
+            *newline = '\0';
+            *line = input->buffer + input->start;
+            *length = newline - *line;
+            input->start = newline - input->buffer + 1;
+            input->scanned = input->start;
+            return INPUT_LINE;
+        }
+
+        if (input->eof) {
+            if (input->start == input->end) {
+                return INPUT_EOF;
+            }
+
+            // Input ended without a trailing newline, hand out what we have
+            input->buffer[input->end] = '\0';
+            *line = input->buffer + input->start;
+            *length = input->end - input->start;
+            input->start = input->end;
+            input->scanned = input->end;
+            return INPUT_LINE;
+        }
+
+        res = input_fill(input);
+        if (res == INPUT_INTERRUPTED || res == INPUT_ERROR) {
+            return res;
+        }
+    }
+}
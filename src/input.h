@@ -0,0 +1,147 @@
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Default size of the input buffer. Reads are done in chunks of up to this
+// size, so the amount of read calls scales with input size / buffer size
+#define INPUT_BUFFER_SIZE 65536
+// Reads of a shared reader that can hand back what it read too far. Every
+// line that is handed back costs reading this again
+#define INPUT_SHARED_READ_SIZE 4096
+
+// A complete line was read
+#define INPUT_LINE 0
+// End of input reached, no more lines will be returned
+#define INPUT_EOF 1
+// Reading was interrupted by a signal (e.g. CTRL + C)
+#define INPUT_INTERRUPTED 2
+// An error occurred while reading
+#define INPUT_ERROR 3
+
+/**
+ * @brief Buffered line reader. Reads data from a file descriptor in large
+ * chunks and hands out complete lines.
+ */
+struct input_t {
+    /**
+     * The file descriptor data is read from
+     */
+    int fd;
+    /**
+     * The buffer holding read, but not yet consumed, data
+     */
+    char *buffer;
+    /**
+     * The allocated size of the buffer
+     */
+    size_t capacity;
+    /**
+     * Index of the first byte that has not been handed out yet
+     */
+    size_t start;
+    /**
+     * Index one past the last valid byte in the buffer
+     */
+    size_t end;
+    /**
+     * Index of the first byte that has not yet been checked for a newline
+     */
+    size_t scanned;
+    /**
+     * If end of input has been reached on the file descriptor
+     */
+    bool eof;
+    /**
+     * If other processes read from the file descriptor too, see input_share()
+     */
+    bool shared;
+    /**
+     * If the file descriptor supports lseek
+     */
+    bool seekable;
+};
+
+/**
+ * @brief Initialize a buffered reader for the given file descriptor
+ *
+ * @param input The reader to initialize
+ * @param fd The file descriptor to read from
+ * @param capacity The initial buffer size. The buffer grows if a single
+ * line does not fit.
+ * @return int - 0 if success, non-zero otherwise
+ */
+int input_init(struct input_t *input, int fd, size_t capacity);
+
+/**
+ * @brief Frees any allocated memory. Does not close the file descriptor.
+ *
+ * @param input The reader
+ */
+void input_finish(struct input_t *input);
+
+/**
+ * @brief Read the next line. The newline character is replaced by a NUL
+ * terminator. If the input ends without a trailing newline the remaining
+ * data is returned as the last line.
+ *
+ * @param input The reader
+ * @param line Output pointer for the line. Points into the internal buffer
+ * and is only valid until the next call on this reader.
+ * @param length Output pointer for the length of the line, excluding the
+ * NUL terminator
+ * @return int - INPUT_LINE, INPUT_EOF, INPUT_INTERRUPTED or INPUT_ERROR
+ */
+int input_read_line(struct input_t *input, char **line, size_t *length);
+
+/**
+ * @brief Check if a complete line (or the end of input) is available, so that
+ * input_read_line will return without reading from the file descriptor
+ *
+ * @param input The reader
+ * @return true if input_read_line will not block
+ */
+bool input_ready(struct input_t *input);
+
+/**
+ * @brief Perform a single read from the file descriptor into the buffer. Use
+ * this together with poll() to read without blocking on partial lines.
+ *
+ * @param input The reader
+ * @return int - INPUT_LINE if data was read, INPUT_EOF, INPUT_INTERRUPTED or
+ * INPUT_ERROR
+ */
+int input_fill(struct input_t *input);
+
+/**
+ * @brief Mark the file descriptor as shared with other processes, e.g. the
+ * stdin the shell reads commands from, which the commands inherit. Data past
+ * the line handed out last must then be left for them. If the file descriptor
+ * supports lseek, it is still read in chunks and input_sync() hands back what
+ * was read too far. Otherwise it is read a byte at a time, so that nothing
+ * past a line is ever read.
+ *
+ * @param input The reader
+ */
+void input_share(struct input_t *input);
+
+/**
+ * @brief Hand back any buffered data that has not yet been handed out to the
+ * file descriptor of a shared reader, so that the next process reading from
+ * it gets the data following the last line. Does nothing for readers that
+ * are not shared, or that do not read past a line anyway.
+ *
+ * @param input The reader
+ */
+void input_sync(struct input_t *input);
+
+/**
+ * @brief Drop any buffered data that has not yet been handed out, e.g. the
+ * partial line that was being typed when CTRL + C was pressed.
+ *
+ * @param input The reader
+ */
+void input_discard(struct input_t *input);
+
+#endif
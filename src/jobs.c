@@ -0,0 +1,282 @@
+#include "jobs.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash.h"
+
+// Initial amount of job slots and PID map entries. Both grow geometrically
+#define JOBS_INITIAL_CAPACITY 16
+#define PIDS_INITIAL_CAPACITY 64
+
+// Entry of the PID map. A PID of 0 marks an empty entry
+struct pid_entry_t {
+    pid_t pid;
+    size_t job;
+    size_t part;
+};
+
+// Job slots, indexed by job ID - 1
+static struct job_t *JOBS = NULL;
+static size_t JOBS_CAPACITY = 0;
+static size_t JOB_COUNT = 0;
+// Highest job ID handed out since the table was last empty
+static size_t LAST_ID = 0;
+
+// Min-heap of the IDs below LAST_ID that are free again
+static size_t *FREE_IDS = NULL;
+static size_t FREE_CAPACITY = 0;
+static size_t FREE_COUNT = 0;
+
+// Open addressing with linear probing, capacity is always a power of two
+static struct pid_entry_t *PIDS = NULL;
+static size_t PIDS_CAPACITY = 0;
+static size_t PID_COUNT = 0;
+
+// PIDs are mostly sequential, which hash_slot() spreads over the table
+static size_t slot_of(pid_t pid, size_t capacity) {
+    return hash_slot(pid, capacity);
+}
+
+static int grow_pids() {
+    size_t capacity = PIDS_CAPACITY ? PIDS_CAPACITY * 2 : PIDS_INITIAL_CAPACITY;
+    struct pid_entry_t *pids = calloc(capacity, sizeof(struct pid_entry_t));
+    if (pids == NULL) {
+        return 1;
+    }
+
+    size_t slot;
+    for (size_t i = 0; i < PIDS_CAPACITY; i++) {
+        if (PIDS[i].pid == 0) {
+            continue;
+        }
+
+        slot = slot_of(PIDS[i].pid, capacity);
+        while (pids[slot].pid != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        pids[slot] = PIDS[i];
+    }
+
+    free(PIDS);
+    PIDS = pids;
+    PIDS_CAPACITY = capacity;
+    return 0;
+}
+
+static int insert_pid(pid_t pid, size_t job, size_t part) {
+    // At most half full, see hash_slot()
+    if ((PID_COUNT + 1) * 2 > PIDS_CAPACITY && grow_pids()) {
+        return 1;
+    }
+
+    size_t slot = slot_of(pid, PIDS_CAPACITY);
+    while (PIDS[slot].pid != 0) {
+        slot = (slot + 1) & (PIDS_CAPACITY - 1);
+    }
+
+    PIDS[slot].pid = pid;
+    PIDS[slot].job = job;
+    PIDS[slot].part = part;
+    PID_COUNT++;
+    return 0;
+}
+
+static struct pid_entry_t *find_pid(pid_t pid) {
+    if (PIDS_CAPACITY == 0) {
+        return NULL;
+    }
+
+    size_t slot = slot_of(pid, PIDS_CAPACITY);
+    while (PIDS[slot].pid != 0) {
+        if (PIDS[slot].pid == pid) {
+            return &PIDS[slot];
+        }
+
+        slot = (slot + 1) & (PIDS_CAPACITY - 1);
+    }
+
+    return NULL;
+}
+
+// Removes the entry and shifts later entries of the same probe sequence back,
+// so that no tombstones are needed
+static void remove_pid(struct pid_entry_t *entry) {
+    size_t mask = PIDS_CAPACITY - 1;
+    size_t hole = entry - PIDS, current = hole, home;
+
+    while (true) {
+        current = (current + 1) & mask;
+        if (PIDS[current].pid == 0) {
+            break;
+        }
+
+        // The entry can fill the hole if the hole lies between its home slot
+        // and where it is now, taking wrap around into account
+        home = slot_of(PIDS[current].pid, PIDS_CAPACITY);
+        if (((current - home) & mask) >= ((current - hole) & mask)) {
+            PIDS[hole] = PIDS[current];
+            hole = current;
+        }
+    }
+
+    PIDS[hole].pid = 0;
+    PID_COUNT--;
+}
+
+static void push_free_id(size_t id) {
+    if (FREE_COUNT == FREE_CAPACITY) {
+        size_t capacity = FREE_CAPACITY ? FREE_CAPACITY * 2 : JOBS_INITIAL_CAPACITY;
+        size_t *reallocated = realloc(FREE_IDS, capacity * sizeof(size_t));
+        if (reallocated == NULL) {
+            // The ID is lost until the table is empty again
+            return;
+        }
+
+        FREE_IDS = reallocated;
+        FREE_CAPACITY = capacity;
+    }
+
+    size_t current = FREE_COUNT++, parent;
+    while (current > 0 && FREE_IDS[parent = (current - 1) / 2] > id) {
+        FREE_IDS[current] = FREE_IDS[parent];
+        current = parent;
+    }
+
+    FREE_IDS[current] = id;
+}
+
+static size_t pop_free_id() {
+    size_t id = FREE_IDS[0], last = FREE_IDS[--FREE_COUNT];
+    size_t current = 0, child;
+
+    while ((child = current * 2 + 1) < FREE_COUNT) {
+        if (child + 1 < FREE_COUNT && FREE_IDS[child + 1] < FREE_IDS[child]) {
+            child++;
+        }
+
+        if (FREE_IDS[child] >= last) {
+            break;
+        }
+
+        FREE_IDS[current] = FREE_IDS[child];
+        current = child;
+    }
+
+    FREE_IDS[current] = last;
+    return id;
+}
+
+// Returns the lowest free job ID, or 0 if memory could not be allocated
+static size_t next_id() {
+    if (FREE_COUNT > 0) {
+        return pop_free_id();
+    }
+
+    if (LAST_ID == JOBS_CAPACITY) {
+        size_t capacity = JOBS_CAPACITY ? JOBS_CAPACITY * 2 : JOBS_INITIAL_CAPACITY;
+        struct job_t *reallocated = realloc(JOBS, capacity * sizeof(struct job_t));
+        if (reallocated == NULL) {
+            return 0;
+        }
+
+        JOBS = reallocated;
+        JOBS_CAPACITY = capacity;
+    }
+
+    return ++LAST_ID;
+}
+
+struct job_t *jobs_add(struct command_execution_t *execution) {
+    size_t id = next_id();
+    if (id == 0) {
+        return NULL;
+    }
+
+    struct job_t *job = &JOBS[id - 1];
+    job->id = id;
+    job->execution = execution;
+    job->running = 0;
+    JOB_COUNT++;
+
+    struct command_part_t *part;
+    for (size_t i = 0; i < execution->part_count; i++) {
+        part = &execution->parts[i];
+        if (!part->running) {
+            continue;
+        }
+
+        if (insert_pid(part->pid, id, i)) {
+            jobs_remove(job);
+            return NULL;
+        }
+
+        job->running++;
+    }
+
+    return job;
+}
+
+struct job_t *jobs_find_pid(pid_t pid, size_t *part) {
+    struct pid_entry_t *entry = find_pid(pid);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    *part = entry->part;
+    return &JOBS[entry->job - 1];
+}
+
+void jobs_part_exited(struct job_t *job, size_t part) {
+    struct pid_entry_t *entry = find_pid(job->execution->parts[part].pid);
+    if (entry == NULL || entry->job != job->id) {
+        return;
+    }
+
+    remove_pid(entry);
+    job->running--;
+}
+
+void jobs_remove(struct job_t *job) {
+    struct command_part_t *part;
+    struct pid_entry_t *entry;
+
+    // Drop the processes that are still indexed, if any
+    for (size_t i = 0; i < job->execution->part_count && job->running > 0; i++) {
+        part = &job->execution->parts[i];
+        entry = part->running ? find_pid(part->pid) : NULL;
+        if (entry != NULL && entry->job == job->id) {
+            remove_pid(entry);
+            job->running--;
+        }
+    }
+
+    job->execution = NULL;
+    JOB_COUNT--;
+
+    // Start handing out IDs from 1 again once everything has completed
+    if (JOB_COUNT == 0) {
+        LAST_ID = 0;
+        FREE_COUNT = 0;
+        return;
+    }
+
+    push_free_id(job->id);
+}
+
+size_t jobs_count() {
+    return JOB_COUNT;
+}
+
+size_t jobs_last_id() {
+    return LAST_ID;
+}
+
+struct job_t *jobs_get(size_t id) {
+    if (id == 0 || id > LAST_ID || JOBS[id - 1].execution == NULL) {
+        return NULL;
+    }
+
+    return &JOBS[id - 1];
+}
@@ -0,0 +1,90 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "commands.h"
+
+/*
+ * Table of the command lines running in the background. Every job gets the
+ * lowest free job ID, and every process of every job is indexed by its PID,
+ * so that a reaped child is mapped to its job and part in constant time.
+ */
+
+struct job_t {
+    /**
+     * Job ID, starting at 1. IDs of completed jobs are reused
+     */
+    size_t id;
+    /**
+     * The command line being executed. NULL if this slot is free
+     */
+    struct command_execution_t *execution;
+    /**
+     * The amount of parts that still have a running process
+     */
+    size_t running;
+};
+
+/**
+ * @brief Add a background job. Every part with a running process is indexed
+ * by its PID.
+ *
+ * @param execution The command line, with the processes of its parts started
+ * @return struct job_t* - The new job, or NULL if memory could not be
+ * allocated
+ */
+struct job_t *jobs_add(struct command_execution_t *execution);
+
+/**
+ * @brief Find the job a process belongs to
+ *
+ * @param pid The PID of the process
+ * @param part Output pointer for the index of the part the process runs
+ * @return struct job_t* - The job, or NULL if the process is not part of any
+ */
+struct job_t *jobs_find_pid(pid_t pid, size_t *part);
+
+/**
+ * @brief Mark the process of a part as completed. Its PID is no longer
+ * indexed after this.
+ *
+ * @param job The job
+ * @param part The index of the part
+ */
+void jobs_part_exited(struct job_t *job, size_t part);
+
+/**
+ * @brief Remove a job from the table, freeing its ID. The execution is not
+ * free'd.
+ *
+ * @param job The job
+ */
+void jobs_remove(struct job_t *job);
+
+/**
+ * @brief The amount of jobs in the table
+ *
+ * @return size_t - The amount of jobs
+ */
+size_t jobs_count();
+
+/**
+ * @brief The highest job ID that may currently be in use. Iterate from 1 up
+ * to and including this with jobs_get() to list every job.
+ *
+ * @return size_t - The highest job ID
+ */
+size_t jobs_last_id();
+
+/**
+ * @brief Get a job by its ID
+ *
+ * @param id The job ID
+ * @return struct job_t* - The job, or NULL if no job has this ID
+ */
+struct job_t *jobs_get(size_t id);
+
+#endif
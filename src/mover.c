@@ -0,0 +1,185 @@
+#define _GNU_SOURCE
+#include "mover.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Ways of moving data, from most to least specialized
+#define MOVE_COPY_FILE_RANGE 0
+#define MOVE_SPLICE 1
+#define MOVE_SENDFILE 2
+#define MOVE_READ_WRITE 3
+
+// Buffer size for the fallback through user space
+#define READ_WRITE_SIZE 65536
+
+bool mover_is_copy(struct command_part_t *part) {
+    if (strcmp(part->executable, "cat")) {
+        return false;
+    }
+
+    // Any option changes the output, so those are left to the real cat
+    for (int i = 1; i < part->argc; i++) {
+        if (part->argv[i][0] == '-' && part->argv[i][1] != '\0') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Picks the most efficient way of moving data between the given kinds of file
+static int select_method(int in, int out) {
+    struct stat in_info, out_info;
+    if (fstat(in, &in_info) || fstat(out, &out_info)) {
+        return MOVE_READ_WRITE;
+    }
+
+    if (S_ISREG(in_info.st_mode) && S_ISREG(out_info.st_mode)) {
+        return MOVE_COPY_FILE_RANGE;
+    }
+
+    if (S_ISFIFO(in_info.st_mode) || S_ISFIFO(out_info.st_mode)) {
+        return MOVE_SPLICE;
+    }
+
+    // E.g. a file to a terminal or socket
+    if (S_ISREG(in_info.st_mode)) {
+        return MOVE_SENDFILE;
+    }
+
+    return MOVE_READ_WRITE;
+}
+
+// Moves a single chunk with the given method. Returns like read(). Sets
+// fatal if data was consumed from the input and then lost, in which case no
+// other method may be tried
+static ssize_t move_chunk(int method, int in, int out, bool *fatal) {
+    static char buffer[READ_WRITE_SIZE];
+    ssize_t res, written, total;
+
+    switch (method) {
+        case MOVE_COPY_FILE_RANGE:
+            return copy_file_range(in, NULL, out, NULL, MOVER_CHUNK_SIZE, 0);
+        case MOVE_SPLICE:
+            return splice(in, NULL, out, NULL, MOVER_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        case MOVE_SENDFILE:
+            return sendfile(out, in, NULL, MOVER_CHUNK_SIZE);
+        default:
+            res = read(in, buffer, sizeof(buffer));
+            for (total = 0; total < res; total += written) {
+                written = write(out, buffer + total, res - total);
+                if (written < 0) {
+                    *fatal = true;
+                    return -1;
+                }
+            }
+
+            return res;
+    }
+}
+
+// Returns the method to fall back to when the kernel rejects the given one
+static int fallback(int method, int in) {
+    struct stat info;
+    if (method != MOVE_SENDFILE && !fstat(in, &info) && S_ISREG(info.st_mode)) {
+        return MOVE_SENDFILE;
+    }
+
+    return MOVE_READ_WRITE;
+}
+
+int mover_copy(int in, int out) {
+    int method = select_method(in, out);
+    bool fatal = false;
+    ssize_t res;
+
+    // No offsets are passed, so the file positions are updated by every
+    // method. This means switching methods halfway through is fine
+    while ((res = move_chunk(method, in, out, &fatal)) != 0) {
+        if (res > 0) {
+            continue;
+        }
+
+        // Interrupted by a signal, which stops the copy like it stops cat
+        if (fatal || errno == EINTR) {
+            return 1;
+        }
+
+        // Not supported for this combination of files, e.g. copy_file_range
+        // across file systems or into a file opened for appending (">>")
+        if (method != MOVE_READ_WRITE &&
+            (errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP ||
+             (errno == EBADF && method == MOVE_COPY_FILE_RANGE))) {
+            method = fallback(method, in);
+            continue;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// Like cat, refuses to copy a regular file into itself, which would never
+// reach the end of the input
+static bool is_output(int in, struct stat *out_info) {
+    struct stat in_info;
+    return S_ISREG(out_info->st_mode) && !fstat(in, &in_info) && in_info.st_dev == out_info->st_dev &&
+           in_info.st_ino == out_info->st_ino;
+}
+
+// Copies a single input to standard output, printing any error under the given name
+static int copy_input(int in, const char *name, struct stat *out_info) {
+    if (is_output(in, out_info)) {
+        fprintf(stderr, "cat: %s: input file is output file\n", name);
+        return EXIT_FAILURE;
+    }
+
+    if (mover_copy(in, STDOUT_FILENO)) {
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int mover_run(struct command_part_t *part) {
+    int status = EXIT_SUCCESS, in;
+    struct stat out_info;
+    if (fstat(STDOUT_FILENO, &out_info)) {
+        fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (part->argc == 1) {
+        return copy_input(STDIN_FILENO, "-", &out_info);
+    }
+
+    for (int i = 1; i < part->argc; i++) {
+        if (!strcmp(part->argv[i], "-")) {
+            in = STDIN_FILENO;
+        } else if ((in = open(part->argv[i], O_RDONLY)) == -1) {
+            fprintf(stderr, "cat: %s: %s\n", part->argv[i], strerror(errno));
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        // Like cat, continue with the next file after a failure
+        if (copy_input(in, part->argv[i], &out_info)) {
+            status = EXIT_FAILURE;
+        }
+
+        if (in != STDIN_FILENO) {
+            close(in);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef __MOVER_H__
+#define __MOVER_H__
+
+#include <stdbool.h>
+
+#include "commands.h"
+
+/*
+ * In-shell replacement for parts that only copy data, e.g. "cat big.log | ..."
+ * or "cat < in > out". The data is moved by the kernel with copy_file_range,
+ * splice or sendfile, depending on the kind of file descriptors involved, so
+ * no exec is needed and no data is copied through user space.
+ */
+
+// Size of a single copy request. Pipes move less than this per call
+#define MOVER_CHUNK_SIZE (1 << 30)
+
+/**
+ * @brief Check if a part is a pure copy, i.e. "cat" with only file arguments
+ * (or "-" for standard input) and no options
+ *
+ * @param part The part to check
+ * @return bool - If the part can be run by mover_run instead
+ */
+bool mover_is_copy(struct command_part_t *part);
+
+/**
+ * @brief Copy all data from one file descriptor to another, until the end of
+ * the input is reached
+ *
+ * @param in The file descriptor to read from
+ * @param out The file descriptor to write to
+ * @return int - 0 if success, non-zero otherwise, with errno set. Being
+ * interrupted by a signal counts as a failure
+ */
+int mover_copy(int in, int out);
+
+/**
+ * @brief Run a part for which mover_is_copy returned true. Expects the I/O
+ * redirection of the part to be applied to standard input and output
+ * already, i.e. this is meant to be called in a forked child.
+ *
+ * @param part The part to run
+ * @return int - The exit status, like cat would give it
+ */
+int mover_run(struct command_part_t *part);
+
+#endif
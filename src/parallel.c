@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "input.h"
+#include "tokenizer.h"
+
+// Buffer size used when reading items from standard input
+#define ITEMS_BUFFER_SIZE 65536
+
+// The amount of CPUs this process may run on
+static size_t default_slots() {
+    cpu_set_t set;
+    if (!sched_getaffinity(0, sizeof(set), &set)) {
+        return CPU_COUNT(&set);
+    }
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? online : 1;
+}
+
+// Parses the template into a plan that is copied for every item. Items are
+// appended as the last argument if the template has no placeholder
+static int make_template(const char *template, struct command_execution_t **plan) {
+    size_t length = strlen(template);
+    bool placeholder = strstr(template, "{}") != NULL;
+
+    struct arena_t *arena = arena_create();
+    if (arena == NULL) {
+        return 1;
+    }
+
+    char *line = arena_alloc(arena, length + 4);
+    if (line == NULL) {
+        arena_free(arena);
+        return 1;
+    }
+
+    strcpy(line, template);
+    if (!placeholder) {
+        strcpy(line + length, " {}");
+        length += 3;
+    }
+
+    struct command_tokens_t tokens;
+    if (tokens_read(&tokens, line, length, arena) || commands_make_plan(line, &tokens, plan)) {
+        arena_free(arena);
+        return 1;
+    }
+
+    // Items are read from standard input, which the commands should not
+    // consume. Like xargs, give them /dev/null instead
+    if ((*plan)->parts[0].in_file == NULL) {
+        (*plan)->parts[0].in_file = "/dev/null";
+    }
+
+    return 0;
+}
+
+// Starts the template for a single item, once a slot is free. Returns
+// non-zero if waiting for a slot was interrupted
+static int run_item(struct command_execution_t *plan, const char *item, struct command_batch_t *batch,
+                    size_t slots) {
+    if (batch->running >= slots && commands_wait_batch(batch, slots - 1)) {
+        return 1;
+    }
+
+    struct command_execution_t *execution;
+    if (commands_instantiate(plan, item, &execution)) {
+        fprintf(stderr, "Failed to allocate memory for item \"%s\"\n", item);
+        batch->completed++;
+        batch->failed++;
+        return 0;
+    }
+
+    if (commands_open_redirects(execution)) {
+        fprintf(stderr, "Failed to open redirection for [%s]: %s\n", execution->command_line,
+                strerror(errno));
+        commands_discard(execution);
+        batch->completed++;
+        batch->failed++;
+        return 0;
+    }
+
+    execution->background = true;
+    execution->batch = batch;
+    batch->running++;
+    commands_execute(execution);
+    return 0;
+}
+
+// Runs the template for every line of standard input
+static int run_input(struct command_execution_t *plan, struct command_batch_t *batch, size_t slots) {
+    struct input_t input;
+    if (input_init(&input, STDIN_FILENO, ITEMS_BUFFER_SIZE)) {
+        fprintf(stderr, "Failed to allocate memory to input buffer!\n");
+        return 1;
+    }
+
+    char *line;
+    size_t length;
+    int res;
+    while ((res = input_read_line(&input, &line, &length)) == INPUT_LINE) {
+        if (length > 0 && run_item(plan, line, batch, slots)) {
+            res = INPUT_INTERRUPTED;
+            break;
+        }
+    }
+
+    input_finish(&input);
+    return res != INPUT_EOF;
+}
+
+int parallel_run(struct command_part_t *part) {
+    size_t slots = default_slots();
+    int arg = 1;
+
+    if (arg + 1 < part->argc && !strcmp(part->argv[arg], "-j")) {
+        slots = strtoul(part->argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+
+    if (arg >= part->argc || slots == 0) {
+        fprintf(stderr, "Usage: parallel [-j slots] template [item...]\n");
+        return EXIT_FAILURE;
+    }
+
+    struct command_execution_t *plan;
+    if (make_template(part->argv[arg], &plan)) {
+        fprintf(stderr, "Failed to parse template [%s]\n", part->argv[arg]);
+        return EXIT_FAILURE;
+    }
+
+    struct command_batch_t batch = {0};
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    int interrupted = 0;
+    if (arg + 1 < part->argc) {
+        for (int i = arg + 1; i < part->argc && !interrupted; i++) {
+            interrupted = run_item(plan, part->argv[i], &batch, slots);
+        }
+    } else {
+        interrupted = run_input(plan, &batch, slots);
+    }
+
+    // Items that are still running when this is interrupted are left to
+    // complete as regular background jobs, no longer accounted in the batch
+    interrupted |= commands_wait_batch(&batch, 0);
+    size_t detached = batch.running;
+    commands_detach_batch(&batch);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    commands_discard(plan);
+
+    double elapsed = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    printf("parallel: %zu items, %zu failed, %zu slots, %.3fs, %.1f items/s", batch.completed, batch.failed, slots,
+           elapsed, elapsed > 0 ? batch.completed / elapsed : 0.0);
+    if (interrupted) {
+        printf(" (interrupted, %zu left running)", detached);
+    }
+    printf("\n");
+
+    return batch.failed > 0 || interrupted ? EXIT_FAILURE : EXIT_SUCCESS;
+}
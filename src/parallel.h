@@ -0,0 +1,25 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include "commands.h"
+
+/*
+ * The parallel builtin. Runs a command line template once for every item,
+ * with a bounded amount of them running at the same time, e.g.
+ *
+ *   parallel -j 8 "gzip -k {}" a.log b.log c.log
+ *   find . -name "*.log" | parallel "gzip -k {}"
+ */
+
+/**
+ * @brief Run the parallel builtin. Usage: parallel [-j slots] template
+ * [item...]. Every "{}" in the template is replaced by the item, and if there
+ * is none the item is appended as the last argument. Without items, every line
+ * of standard input is an item. Slots default to the amount of usable CPUs.
+ *
+ * @param part The part invoking the builtin
+ * @return int - 0 if every item succeeded, non-zero otherwise
+ */
+int parallel_run(struct command_part_t *part);
+
+#endif
@@ -0,0 +1,196 @@
+#include "pathcache.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.h"
+
+struct pathcache_entry_t {
+    char *name;
+    char *path;
+    size_t hits;
+    struct pathcache_entry_t *next;
+};
+
+static struct pathcache_entry_t *BUCKETS[PATHCACHE_BUCKETS];
+static struct pathcache_stats_t STATS = {0};
+// The value of $PATH the cached entries were resolved with
+static char *CACHED_PATH = NULL;
+// Holds the result of lookups that are not cached
+static char *UNCACHED_RESULT = NULL;
+
+static size_t bucket_of(const char *name) {
+    return hash_string(name) & (PATHCACHE_BUCKETS - 1);
+}
+
+static struct pathcache_entry_t **find(const char *name) {
+    struct pathcache_entry_t **current = &BUCKETS[bucket_of(name)];
+    while (*current != NULL && strcmp((*current)->name, name)) {
+        current = &(*current)->next;
+    }
+
+    return current;
+}
+
+static void free_entry(struct pathcache_entry_t *entry) {
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+static void remove_all() {
+    struct pathcache_entry_t *entry, *next;
+    for (size_t i = 0; i < PATHCACHE_BUCKETS; i++) {
+        for (entry = BUCKETS[i]; entry != NULL; entry = next) {
+            next = entry->next;
+            free_entry(entry);
+        }
+
+        BUCKETS[i] = NULL;
+    }
+
+    STATS.entries = 0;
+}
+
+// Flushes the cache if $PATH has changed since the entries were resolved
+static void check_path(const char *path) {
+    if (CACHED_PATH != NULL && !strcmp(CACHED_PATH, path)) {
+        return;
+    }
+
+    remove_all();
+    free(CACHED_PATH);
+    CACHED_PATH = strdup(path);
+}
+
+static bool is_executable(const char *path) {
+    struct stat info;
+    return access(path, X_OK) == 0 && stat(path, &info) == 0 && S_ISREG(info.st_mode);
+}
+
+// Walks $PATH the same way execvp does. Sets relative if the match was found
+// through a relative entry, which depends on the working directory
+static char *resolve(const char *name, const char *path, bool *relative) {
+    size_t name_len = strlen(name), dir_len;
+    const char *dir = path, *end;
+    char *candidate;
+
+    while (true) {
+        end = strchr(dir, ':');
+        dir_len = end != NULL ? (size_t)(end - dir) : strlen(dir);
+
+        // An empty entry means the current directory
+        candidate = malloc(dir_len + name_len + 3);
+        if (candidate == NULL) {
+            return NULL;
+        }
+
+        if (dir_len == 0) {
+            memcpy(candidate, "./", 2);
+            memcpy(candidate + 2, name, name_len + 1);
+        } else {
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            memcpy(candidate + dir_len + 1, name, name_len + 1);
+        }
+
+        if (is_executable(candidate)) {
+            *relative = candidate[0] != '/';
+            return candidate;
+        }
+
+        free(candidate);
+        if (end == NULL) {
+            return NULL;
+        }
+
+        dir = end + 1;
+    }
+}
+
+const char *pathcache_lookup(const char *name, bool *cached) {
+    *cached = false;
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    const char *path = getenv("PATH");
+    if (path == NULL) {
+        path = "/bin:/usr/bin";  // Same default as execvp
+    }
+
+    check_path(path);
+
+    struct pathcache_entry_t **slot = find(name);
+    if (*slot != NULL) {
+        STATS.hits++;
+        (*slot)->hits++;
+        *cached = true;
+        return (*slot)->path;
+    }
+
+    STATS.misses++;
+
+    bool relative;
+    char *resolved = resolve(name, path, &relative);
+    if (resolved == NULL) {
+        return NULL;
+    }
+
+    // Matches through relative $PATH entries change with the working
+    // directory, so these are not cached
+    struct pathcache_entry_t *entry = relative ? NULL : malloc(sizeof(struct pathcache_entry_t));
+    if (entry == NULL || (entry->name = strdup(name)) == NULL) {
+        free(entry);
+        free(UNCACHED_RESULT);
+        UNCACHED_RESULT = resolved;
+        return resolved;
+    }
+
+    entry->path = resolved;
+    entry->hits = 1;
+    entry->next = NULL;
+    *slot = entry;
+    STATS.entries++;
+    return resolved;
+}
+
+void pathcache_forget(const char *name) {
+    struct pathcache_entry_t **slot = find(name);
+    if (*slot == NULL) {
+        return;
+    }
+
+    struct pathcache_entry_t *entry = *slot;
+    *slot = entry->next;
+    free_entry(entry);
+    STATS.entries--;
+}
+
+void pathcache_clear() {
+    remove_all();
+    memset(&STATS, 0, sizeof(STATS));
+}
+
+void pathcache_stats(struct pathcache_stats_t *stats) {
+    *stats = STATS;
+}
+
+void pathcache_print(FILE *out) {
+    if (STATS.entries == 0) {
+        fprintf(out, "hash: hash table empty\n");
+    } else {
+        fprintf(out, "hits\tcommand\n");
+        struct pathcache_entry_t *entry;
+        for (size_t i = 0; i < PATHCACHE_BUCKETS; i++) {
+            for (entry = BUCKETS[i]; entry != NULL; entry = entry->next) {
+                fprintf(out, "%4zu\t%s\n", entry->hits, entry->path);
+            }
+        }
+    }
+
+    fprintf(out, "Path cache: %zu hits, %zu misses, %zu entries\n", STATS.hits, STATS.misses, STATS.entries);
+}
@@ -0,0 +1,61 @@
+#ifndef __PATHCACHE_H__
+#define __PATHCACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Cache mapping executable names to their resolved absolute path, so that
+ * launching a command does not have to walk $PATH every time. The cache is
+ * flushed automatically when $PATH changes.
+ */
+
+// Must be a power of two
+#define PATHCACHE_BUCKETS 128
+
+struct pathcache_stats_t {
+    size_t hits;
+    size_t misses;
+    size_t entries;
+};
+
+/**
+ * @brief Resolve the given executable name. Names containing a '/' are
+ * returned as is.
+ *
+ * @param name The executable name, e.g. "ls"
+ * @param cached Output pointer, set to true if the result came from the cache
+ * @return const char* - The path to execute, or NULL if the name could not be
+ * found in $PATH. Only valid until the next call to any pathcache function.
+ */
+const char *pathcache_lookup(const char *name, bool *cached);
+
+/**
+ * @brief Remove the given name from the cache, e.g. because the cached path
+ * could no longer be executed
+ *
+ * @param name The executable name
+ */
+void pathcache_forget(const char *name);
+
+/**
+ * @brief Remove all entries from the cache and reset the counters
+ */
+void pathcache_clear();
+
+/**
+ * @brief Get the hit/miss counters of the cache
+ *
+ * @param stats Output location for the counters
+ */
+void pathcache_stats(struct pathcache_stats_t *stats);
+
+/**
+ * @brief Print every cached entry, with the amount of times it has been used
+ *
+ * @param out Where to print the entries
+ */
+void pathcache_print(FILE *out);
+
+#endif
@@ -0,0 +1,158 @@
+#include "plancache.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+
+struct plancache_entry_t {
+    uint64_t hash;
+    size_t length;
+    /**
+     * The cached plan. The entry itself is allocated from the arena of the
+     * plan, so freeing the plan frees the entry.
+     */
+    struct command_execution_t *plan;
+    struct plancache_entry_t *bucket_next;
+    // Most recently used entries are at the head of the list
+    struct plancache_entry_t *lru_prev;
+    struct plancache_entry_t *lru_next;
+};
+
+static struct plancache_entry_t *BUCKETS[PLANCACHE_BUCKETS];
+static struct plancache_entry_t *LRU_HEAD = NULL;
+static struct plancache_entry_t *LRU_TAIL = NULL;
+static struct plancache_stats_t STATS = {0};
+
+static void lru_unlink(struct plancache_entry_t *entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        LRU_HEAD = entry->lru_next;
+    }
+
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        LRU_TAIL = entry->lru_prev;
+    }
+}
+
+static void lru_push_front(struct plancache_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = LRU_HEAD;
+    if (LRU_HEAD != NULL) {
+        LRU_HEAD->lru_prev = entry;
+    } else {
+        LRU_TAIL = entry;
+    }
+
+    LRU_HEAD = entry;
+}
+
+static struct plancache_entry_t *find(char *command_line, size_t length, uint64_t hash) {
+    struct plancache_entry_t *entry = BUCKETS[hash & (PLANCACHE_BUCKETS - 1)];
+    while (entry != NULL) {
+        if (entry->hash == hash && entry->length == length &&
+            !memcmp(entry->plan->command_line, command_line, length)) {
+            return entry;
+        }
+
+        entry = entry->bucket_next;
+    }
+
+    return NULL;
+}
+
+static void evict(struct plancache_entry_t *entry) {
+    struct plancache_entry_t **current = &BUCKETS[entry->hash & (PLANCACHE_BUCKETS - 1)];
+    while (*current != entry) {
+        current = &(*current)->bucket_next;
+    }
+
+    *current = entry->bucket_next;
+    lru_unlink(entry);
+    STATS.entries--;
+
+    // This also frees the entry
+    arena_free(entry->plan->arena);
+}
+
+int plancache_get(char *command_line, size_t length, struct command_execution_t **execution) {
+    struct plancache_entry_t *entry = find(command_line, length, hash_bytes(command_line, length));
+    if (entry == NULL) {
+        STATS.misses++;
+        return PLANCACHE_MISS;
+    }
+
+    STATS.hits++;
+    lru_unlink(entry);
+    lru_push_front(entry);
+
+    if (commands_copy_plan(entry->plan, execution)) {
+        return PLANCACHE_ERROR;
+    }
+
+    if (commands_open_redirects(*execution)) {
+        int error = errno;
+        arena_free((*execution)->arena);
+        errno = error;
+        return PLANCACHE_REDIRECT_ERROR;
+    }
+
+    return PLANCACHE_HIT;
+}
+
+int plancache_put(struct command_execution_t *execution) {
+    // The body of a here-document is not part of the line, so the same line
+    // can feed different content every time
+    if (commands_has_heredoc(execution)) {
+        return 0;
+    }
+
+    size_t length = strlen(execution->command_line);
+    uint64_t hash = hash_bytes(execution->command_line, length);
+    if (find(execution->command_line, length, hash) != NULL) {
+        return 0;  // Already cached
+    }
+
+    struct command_execution_t *plan;
+    if (commands_copy_plan(execution, &plan)) {
+        return 1;
+    }
+
+    struct plancache_entry_t *entry = arena_alloc(plan->arena, sizeof(struct plancache_entry_t));
+    if (entry == NULL) {
+        arena_free(plan->arena);
+        return 1;
+    }
+
+    if (STATS.entries == PLANCACHE_MAX_ENTRIES) {
+        evict(LRU_TAIL);
+        STATS.evictions++;
+    }
+
+    entry->hash = hash;
+    entry->length = length;
+    entry->plan = plan;
+
+    size_t bucket = hash & (PLANCACHE_BUCKETS - 1);
+    entry->bucket_next = BUCKETS[bucket];
+    BUCKETS[bucket] = entry;
+    lru_push_front(entry);
+    STATS.entries++;
+    return 0;
+}
+
+void plancache_clear() {
+    while (LRU_HEAD != NULL) {
+        evict(LRU_HEAD);
+    }
+
+    memset(&STATS, 0, sizeof(STATS));
+}
+
+void plancache_stats(struct plancache_stats_t *stats) {
+    *stats = STATS;
+}
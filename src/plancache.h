@@ -0,0 +1,69 @@
+#ifndef __PLANCACHE_H__
+#define __PLANCACHE_H__
+
+#include <stddef.h>
+
+#include "commands.h"
+
+/*
+ * Cache of parsed command lines. Repeated command lines skip tokenizing and
+ * parsing, and only have their redirection files opened again. The cache
+ * holds at most PLANCACHE_MAX_ENTRIES plans, evicting the least recently
+ * used one when full.
+ */
+
+#define PLANCACHE_MAX_ENTRIES 256
+// Must be a power of two
+#define PLANCACHE_BUCKETS 512
+
+// The command line was found, and a ready to execute copy was made
+#define PLANCACHE_HIT 0
+// The command line was not found
+#define PLANCACHE_MISS 1
+// The command line was found, but memory for the copy could not be allocated
+#define PLANCACHE_ERROR 2
+// The command line was found, but a redirection file of the copy could not
+// be opened. errno tells why
+#define PLANCACHE_REDIRECT_ERROR 3
+
+struct plancache_stats_t {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t entries;
+};
+
+/**
+ * @brief Look up a command line in the cache
+ *
+ * @param command_line The command line
+ * @param length The length of the command line
+ * @param execution Output pointer for a copy of the cached plan on a hit. The
+ * copy owns its own arena, and has its redirection files opened.
+ * @return int - PLANCACHE_HIT, PLANCACHE_MISS, PLANCACHE_ERROR or
+ * PLANCACHE_REDIRECT_ERROR
+ */
+int plancache_get(char *command_line, size_t length, struct command_execution_t **execution);
+
+/**
+ * @brief Store the plan of a freshly parsed execution. The cache makes its own
+ * copy, so the execution can be used and free'd as usual.
+ *
+ * @param execution The execution
+ * @return int - 0 if success, non-zero otherwise
+ */
+int plancache_put(struct command_execution_t *execution);
+
+/**
+ * @brief Remove every cached plan and reset the counters
+ */
+void plancache_clear();
+
+/**
+ * @brief Get the hit/miss counters of the cache
+ *
+ * @param stats Output location for the counters
+ */
+void plancache_stats(struct plancache_stats_t *stats);
+
+#endif
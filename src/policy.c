@@ -0,0 +1,383 @@
+#define _GNU_SOURCE
+#include "policy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mntent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "commands.h"
+
+// From linux/ioprio.h, which is not exposed by glibc
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+// One entry for every supported resource
+#define POLICY_MAX_LIMITS 3
+
+// Used if no cgroup2 file system is found in /proc/self/mounts
+#define DEFAULT_CGROUP_ROOT "/sys/fs/cgroup"
+
+struct policy_limit_t {
+    int resource;
+    rlim_t value;
+};
+
+struct command_policy_t {
+    // One affinity mask per part, the last one applies to remaining parts
+    cpu_set_t *cpus;
+    size_t cpus_count;
+    bool nice_set;
+    int nice;
+    bool ioprio_set;
+    int ioprio;
+    struct policy_limit_t limits[POLICY_MAX_LIMITS];
+    size_t limit_count;
+    // Parent of the per-run cgroups, relative to the cgroup2 mount
+    char *cgroup;
+};
+
+// Counter making the names of the per-run cgroups unique
+static size_t CGROUP_COUNTER = 0;
+static char *CGROUP_ROOT = NULL;
+
+// Parses a list like "0,2-3" into the set
+static int parse_cpus(const char *text, const char *end, cpu_set_t *set) {
+    char *next;
+    unsigned long first, last;
+
+    CPU_ZERO(set);
+    while (text < end) {
+        first = strtoul(text, &next, 10);
+        if (next == text) {
+            return 1;
+        }
+
+        last = first;
+        if (*next == '-') {
+            text = next + 1;
+            last = strtoul(text, &next, 10);
+            if (next == text) {
+                return 1;
+            }
+        }
+
+        if (first > last || last >= CPU_SETSIZE) {
+            return 1;
+        }
+
+        for (; first <= last; first++) {
+            CPU_SET(first, set);
+        }
+
+        if (next < end && *next != ',') {
+            return 1;
+        }
+
+        text = next < end ? next + 1 : next;
+    }
+
+    return CPU_COUNT(set) == 0;
+}
+
+static int parse_affinity(struct arena_t *arena, struct command_policy_t *policy, const char *text) {
+    size_t count = 1;
+    for (const char *current = text; *current; current++) {
+        count += *current == ':';
+    }
+
+    cpu_set_t *cpus = arena_alloc(arena, sizeof(cpu_set_t) * count);
+    if (cpus == NULL) {
+        return POLICY_INVALID;
+    }
+
+    const char *end;
+    for (size_t i = 0; i < count; i++) {
+        end = strchr(text, ':');
+        if (end == NULL) {
+            end = text + strlen(text);
+        }
+
+        if (parse_cpus(text, end, &cpus[i])) {
+            return POLICY_INVALID;
+        }
+
+        text = end + 1;
+    }
+
+    policy->cpus = cpus;
+    policy->cpus_count = count;
+    return POLICY_PARSED;
+}
+
+static int parse_ionice(struct command_policy_t *policy, const char *text) {
+    const char *level = strchr(text, ':');
+    size_t length = level != NULL ? (size_t)(level - text) : strlen(text);
+    int class;
+    long data = 4;  // The kernel default for best-effort
+
+    if (!strncmp(text, "idle", length) && length == 4) {
+        class = IOPRIO_CLASS_IDLE;
+        data = 0;
+    } else if ((length == 2 && !strncmp(text, "be", 2)) || (length == 11 && !strncmp(text, "best-effort", 11))) {
+        class = IOPRIO_CLASS_BE;
+    } else if ((length == 2 && !strncmp(text, "rt", 2)) || (length == 8 && !strncmp(text, "realtime", 8))) {
+        class = IOPRIO_CLASS_RT;
+    } else {
+        return POLICY_INVALID;
+    }
+
+    if (level != NULL) {
+        char *end;
+        data = strtol(level + 1, &end, 10);
+        if (end == level + 1 || *end != '\0' || data < 0 || data > 7 || class == IOPRIO_CLASS_IDLE) {
+            return POLICY_INVALID;
+        }
+    }
+
+    policy->ioprio = class << IOPRIO_CLASS_SHIFT | data;
+    policy->ioprio_set = true;
+    return POLICY_PARSED;
+}
+
+// Sizes may have a K, M or G suffix. Other limits, e.g. CPU seconds, are
+// plain integers
+static int parse_limit(struct command_policy_t *policy, int resource, const char *text) {
+    size_t value;
+    char *end;
+    if (resource == RLIMIT_AS) {
+        if (commands_parse_size(text, &value)) {
+            return POLICY_INVALID;
+        }
+    } else {
+        errno = 0;
+        value = strtoul(text, &end, 10);
+        if (errno || end == text || *end != '\0' || text[0] == '-') {
+            return POLICY_INVALID;
+        }
+    }
+
+    // Giving the same limit again replaces it
+    size_t i = 0;
+    while (i < policy->limit_count && policy->limits[i].resource != resource) {
+        i++;
+    }
+
+    policy->limits[i].resource = resource;
+    policy->limits[i].value = value;
+    if (i == policy->limit_count) {
+        policy->limit_count++;
+    }
+
+    return POLICY_PARSED;
+}
+
+// Returns the value if the token starts with the given key, NULL otherwise
+static const char *value_of(const char *token, const char *key) {
+    size_t length = strlen(key);
+    return strncmp(token, key, length) ? NULL : token + length;
+}
+
+int policy_parse(struct arena_t *arena, struct command_policy_t **policy, const char *token) {
+    static const char *keys[] = {"cpus=", "nice=", "ionice=", "rlimit-as=", "rlimit-cpu=", "rlimit-nofile=", "cgroup="};
+    const char *value = NULL;
+    size_t key = 0;
+    for (; key < sizeof(keys) / sizeof(keys[0]) && value == NULL; key++) {
+        value = value_of(token, keys[key]);
+    }
+
+    if (value == NULL) {
+        return POLICY_NONE;
+    }
+
+    if (*policy == NULL) {
+        *policy = arena_alloc(arena, sizeof(struct command_policy_t));
+        if (*policy == NULL) {
+            return POLICY_INVALID;
+        }
+
+        memset(*policy, 0, sizeof(struct command_policy_t));
+    }
+
+    char *end;
+    switch (key - 1) {
+        case 0:
+            return parse_affinity(arena, *policy, value);
+        case 1:
+            (*policy)->nice = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || (*policy)->nice < -20 || (*policy)->nice > 19) {
+                return POLICY_INVALID;
+            }
+
+            (*policy)->nice_set = true;
+            return POLICY_PARSED;
+        case 2:
+            return parse_ionice(*policy, value);
+        case 3:
+            return parse_limit(*policy, RLIMIT_AS, value);
+        case 4:
+            return parse_limit(*policy, RLIMIT_CPU, value);
+        case 5:
+            return parse_limit(*policy, RLIMIT_NOFILE, value);
+        default:
+            if (*value == '\0' || strstr(value, "..") != NULL) {
+                return POLICY_INVALID;
+            }
+
+            (*policy)->cgroup = arena_strndup(arena, value, strlen(value));
+            return (*policy)->cgroup != NULL ? POLICY_PARSED : POLICY_INVALID;
+    }
+}
+
+struct command_policy_t *policy_copy(struct arena_t *arena, struct command_policy_t *policy, bool *failed) {
+    if (policy == NULL) {
+        return NULL;
+    }
+
+    struct command_policy_t *copy = arena_alloc(arena, sizeof(struct command_policy_t));
+    if (copy == NULL) {
+        *failed = true;
+        return NULL;
+    }
+
+    *copy = *policy;
+    if (policy->cpus != NULL) {
+        copy->cpus = arena_alloc(arena, sizeof(cpu_set_t) * policy->cpus_count);
+        if (copy->cpus == NULL) {
+            *failed = true;
+            return NULL;
+        }
+
+        memcpy(copy->cpus, policy->cpus, sizeof(cpu_set_t) * policy->cpus_count);
+    }
+
+    if (policy->cgroup != NULL) {
+        copy->cgroup = arena_strndup(arena, policy->cgroup, strlen(policy->cgroup));
+        if (copy->cgroup == NULL) {
+            *failed = true;
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+// Finds where the cgroup v2 hierarchy is mounted
+static const char *cgroup_root() {
+    if (CGROUP_ROOT != NULL) {
+        return CGROUP_ROOT;
+    }
+
+    FILE *mounts = setmntent("/proc/self/mounts", "r");
+    struct mntent *entry;
+    while (mounts != NULL && (entry = getmntent(mounts)) != NULL) {
+        if (!strcmp(entry->mnt_type, "cgroup2")) {
+            CGROUP_ROOT = strdup(entry->mnt_dir);
+            break;
+        }
+    }
+
+    if (mounts != NULL) {
+        endmntent(mounts);
+    }
+
+    if (CGROUP_ROOT == NULL) {
+        CGROUP_ROOT = DEFAULT_CGROUP_ROOT;
+    }
+
+    return CGROUP_ROOT;
+}
+
+int policy_create_cgroup(struct arena_t *arena, struct command_policy_t *policy, char **cgroup) {
+    *cgroup = NULL;
+    if (policy->cgroup == NULL) {
+        return 0;
+    }
+
+    const char *root = cgroup_root();
+    size_t size = strlen(root) + strlen(policy->cgroup) + 64;
+    char *path = arena_alloc(arena, size);
+    if (path == NULL) {
+        fprintf(stderr, "Failed to allocate memory for cgroup path\n");
+        return 1;
+    }
+
+    snprintf(path, size, "%s/%s/flush-%d-%zu", root, policy->cgroup, getpid(), ++CGROUP_COUNTER);
+    if (mkdir(path, 0755)) {
+        fprintf(stderr, "Failed to create cgroup \"%s\": %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    *cgroup = path;
+    return 0;
+}
+
+void policy_remove_cgroup(const char *path) {
+    if (rmdir(path)) {
+        fprintf(stderr, "Failed to remove cgroup \"%s\": %s\n", path, strerror(errno));
+    }
+}
+
+// Moves the calling process into the cgroup
+static int join_cgroup(const char *cgroup) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+
+    int fd = open(path, O_WRONLY);
+    if (fd == -1) {
+        return 1;
+    }
+
+    // Writing 0 moves the writing process
+    int res = write(fd, "0", 1) != 1;
+    close(fd);
+    return res;
+}
+
+int policy_apply(struct command_policy_t *policy, size_t part, const char *cgroup) {
+    if (cgroup != NULL && join_cgroup(cgroup)) {
+        fprintf(stderr, "Failed to join cgroup \"%s\": %s\n", cgroup, strerror(errno));
+        return 1;
+    }
+
+    if (policy->cpus != NULL) {
+        cpu_set_t *cpus = &policy->cpus[part < policy->cpus_count ? part : policy->cpus_count - 1];
+        if (sched_setaffinity(0, sizeof(cpu_set_t), cpus)) {
+            fprintf(stderr, "Failed to set CPU affinity: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    if (policy->nice_set && setpriority(PRIO_PROCESS, 0, policy->nice)) {
+        fprintf(stderr, "Failed to set nice value %d: %s\n", policy->nice, strerror(errno));
+        return 1;
+    }
+
+    if (policy->ioprio_set && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, policy->ioprio)) {
+        fprintf(stderr, "Failed to set I/O priority: %s\n", strerror(errno));
+        return 1;
+    }
+
+    struct rlimit limit;
+    for (size_t i = 0; i < policy->limit_count; i++) {
+        limit.rlim_cur = policy->limits[i].value;
+        limit.rlim_max = policy->limits[i].value;
+        if (setrlimit(policy->limits[i].resource, &limit)) {
+            fprintf(stderr, "Failed to set resource limit: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/*
+ * Scheduling and resource policy of a command line, given as prefixes before
+ * the first command, e.g. "cpus=2-3 nice=10 rlimit-as=2G make -j2 &".
+ *
+ *   cpus=LIST[:LIST]...   CPU affinity, e.g. "0,2-3". One list per part, the
+ *                         last list applies to any remaining parts
+ *   nice=N                Nice value of every process
+ *   ionice=CLASS[:LEVEL]  I/O priority, CLASS being idle, best-effort (be)
+ *                         or realtime (rt), with a LEVEL from 0 to 7
+ *   rlimit-as=SIZE        Address space limit in bytes, K, M and G suffixes
+ *   rlimit-cpu=SECONDS    CPU time limit
+ *   rlimit-nofile=N       Open file limit
+ *   cgroup=PATH           Place the job in a new cgroup below PATH, relative
+ *                         to the cgroup v2 mount. The command line is not run
+ *                         if the cgroup can not be created
+ */
+
+// Opaque, allocated from the arena of the command line
+struct command_policy_t;
+
+// The token was a policy prefix and has been applied
+#define POLICY_PARSED 0
+// The token is not a policy prefix
+#define POLICY_NONE 1
+// The token is a policy prefix, but its value is invalid
+#define POLICY_INVALID 2
+
+/**
+ * @brief Parse a prefix token into the policy, allocating the policy if it
+ * does not exist yet
+ *
+ * @param arena The arena of the command line
+ * @param policy The policy, pointing to NULL if there is none yet
+ * @param token The token, e.g. "nice=10"
+ * @return int - POLICY_PARSED, POLICY_NONE or POLICY_INVALID
+ */
+int policy_parse(struct arena_t *arena, struct command_policy_t **policy, const char *token);
+
+/**
+ * @brief Copy a policy into another arena
+ *
+ * @param arena The arena to copy into
+ * @param policy The policy to copy, may be NULL
+ * @param failed Set to true if memory could not be allocated
+ * @return struct command_policy_t* - The copy, NULL if policy is NULL
+ */
+struct command_policy_t *policy_copy(struct arena_t *arena, struct command_policy_t *policy, bool *failed);
+
+/**
+ * @brief Create the cgroup for a single run of a command line, if the policy
+ * asks for one
+ *
+ * @param arena The arena of the command line, holding the returned path
+ * @param policy The policy
+ * @param cgroup Output location for the path of the created cgroup, set to
+ * NULL if the policy has none
+ * @return int - 0 if success, non-zero if the cgroup could not be created
+ */
+int policy_create_cgroup(struct arena_t *arena, struct command_policy_t *policy, char **cgroup);
+
+/**
+ * @brief Remove a cgroup created by policy_create_cgroup, once every process
+ * in it has exited
+ *
+ * @param path The path of the cgroup
+ */
+void policy_remove_cgroup(const char *path);
+
+/**
+ * @brief Apply the policy to the calling process. Meant to be called in a
+ * forked child, before exec.
+ *
+ * @param policy The policy
+ * @param part The index of the part the process runs
+ * @param cgroup The cgroup created for this run, or NULL
+ * @return int - 0 if success, non-zero otherwise
+ */
+int policy_apply(struct command_policy_t *policy, size_t part, const char *cgroup);
+
+#endif
@@ -0,0 +1,152 @@
+#include "scan.h"
+
+#include <stdbool.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_HAS_X86 1
+#endif
+
+const unsigned char CHAR_CLASS[256] = {
+    [' '] = CLASS_WHITESPACE,
+    ['\t'] = CLASS_WHITESPACE,
+    ['<'] = CLASS_IO_REDIRECT,
+    ['>'] = CLASS_IO_REDIRECT,
+    ['|'] = CLASS_PIPE_SPLIT,
+    ['"'] = CLASS_QUOTE,
+    ['\\'] = CLASS_ESCAPE,
+};
+
+static size_t scan_scalar(const char *input, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (CHAR_IS(input[i], CLASS_SPECIAL)) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+#ifdef SCAN_HAS_X86
+// SSE2 is part of the x86-64 baseline, so this is always available there
+static size_t scan_sse2(const char *input, size_t len) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i less = _mm_set1_epi8('<');
+    const __m128i greater = _mm_set1_epi8('>');
+    const __m128i pipe = _mm_set1_epi8('|');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i escape = _mm_set1_epi8('\\');
+
+    size_t i = 0;
+    __m128i chunk, match;
+    unsigned int mask;
+    for (; i + 16 <= len; i += 16) {
+        chunk = _mm_loadu_si128((const __m128i *)(input + i));
+        match = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, less));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, greater));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, pipe));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, quote));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, escape));
+
+        mask = _mm_movemask_epi8(match);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_scalar(input + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *input, size_t len) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i less = _mm256_set1_epi8('<');
+    const __m256i greater = _mm256_set1_epi8('>');
+    const __m256i pipe = _mm256_set1_epi8('|');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i escape = _mm256_set1_epi8('\\');
+
+    size_t i = 0;
+    __m256i chunk, match;
+    unsigned int mask;
+    for (; i + 32 <= len; i += 32) {
+        chunk = _mm256_loadu_si256((const __m256i *)(input + i));
+        match = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab));
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, less));
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, greater));
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, pipe));
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, quote));
+        match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, escape));
+
+        mask = _mm256_movemask_epi8(match);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    // Let SSE2 handle the remainder, which also covers the last few bytes
+    return i + scan_sse2(input + i, len - i);
+}
+#endif
+
+static int SELECTED = -1;
+static size_t (*SCANNER)(const char *, size_t) = NULL;
+
+static bool is_supported(int implementation) {
+    switch (implementation) {
+        case SCAN_SCALAR:
+            return true;
+#ifdef SCAN_HAS_X86
+        case SCAN_SSE2:
+            return true;
+        case SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+int scan_select(int implementation) {
+    if (!is_supported(implementation)) {
+        return 1;
+    }
+
+    switch (implementation) {
+#ifdef SCAN_HAS_X86
+        case SCAN_SSE2:
+            SCANNER = scan_sse2;
+            break;
+        case SCAN_AVX2:
+            SCANNER = scan_avx2;
+            break;
+#endif
+        default:
+            SCANNER = scan_scalar;
+            break;
+    }
+
+    SELECTED = implementation;
+    return 0;
+}
+
+int scan_selected() {
+    if (SELECTED == -1) {
+        // Pick the fastest supported implementation
+        if (scan_select(SCAN_AVX2) && scan_select(SCAN_SSE2)) {
+            scan_select(SCAN_SCALAR);
+        }
+    }
+
+    return SELECTED;
+}
+
+size_t scan_special(const char *input, size_t len) {
+    if (SCANNER == NULL) {
+        scan_selected();
+    }
+
+    return SCANNER(input, len);
+}
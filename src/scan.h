@@ -0,0 +1,56 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stddef.h>
+
+/*
+ * Character classes used by the tokenizer, and a scanner that finds the next
+ * character that belongs to any of them. On x86-64 the scanner uses SSE2, or
+ * AVX2 when the CPU supports it, to check 16 or 32 bytes at a time.
+ */
+
+#define CLASS_WHITESPACE 0x01
+#define CLASS_IO_REDIRECT 0x02
+#define CLASS_PIPE_SPLIT 0x04
+#define CLASS_QUOTE 0x08
+#define CLASS_ESCAPE 0x10
+
+// Any character that the tokenizer has to look at individually
+#define CLASS_SPECIAL (CLASS_WHITESPACE | CLASS_IO_REDIRECT | CLASS_PIPE_SPLIT | CLASS_QUOTE | CLASS_ESCAPE)
+
+// Class of every byte value
+extern const unsigned char CHAR_CLASS[256];
+
+#define CHAR_IS(x, class) (CHAR_CLASS[(unsigned char)(x)] & (class))
+
+// Scanner implementations
+#define SCAN_SCALAR 0
+#define SCAN_SSE2 1
+#define SCAN_AVX2 2
+
+/**
+ * @brief Find the first character in the CLASS_SPECIAL class
+ *
+ * @param input The input
+ * @param len The amount of characters to check
+ * @return size_t - Index of the first special character, or len if there is none
+ */
+size_t scan_special(const char *input, size_t len);
+
+/**
+ * @brief Select the scanner implementation. By default the fastest one
+ * supported by the CPU is picked on first use.
+ *
+ * @param implementation One of SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+ * @return int - 0 if success, non-zero if not supported on this CPU
+ */
+int scan_select(int implementation);
+
+/**
+ * @brief The scanner implementation currently in use
+ *
+ * @return int - One of SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+ */
+int scan_selected();
+
+#endif
@@ -0,0 +1,149 @@
+#include "stats.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#include "pathcache.h"
+#include "plancache.h"
+
+struct histogram_t {
+    size_t count;
+    long total;
+    long max;
+    size_t buckets[STATS_BUCKETS];
+};
+
+static const char *COUNTER_NAMES[STATS_COUNTERS] = {
+    "command lines", "builtins", "external", "data copies", "forks", "spawns", "launch failures", "background jobs",
+};
+
+static const char *HISTOGRAM_NAMES[STATS_HISTOGRAMS] = {"parse", "launch", "foreground"};
+
+static size_t COUNTERS[STATS_COUNTERS];
+static struct histogram_t HISTOGRAMS[STATS_HISTOGRAMS];
+
+// Cache counters at the last reset, since resetting does not clear the caches
+static struct plancache_stats_t PLANCACHE_BASE;
+static struct pathcache_stats_t PATHCACHE_BASE;
+
+// Values below STATS_SUB_BUCKETS get a bucket each. Above that, every power
+// of two is split into STATS_SUB_BUCKETS buckets of equal width
+static size_t bucket_of(long value) {
+    if (value < STATS_SUB_BUCKETS) {
+        return value < 0 ? 0 : value;
+    }
+
+    int shift = 63 - __builtin_clzl(value) - STATS_SUB_BUCKET_BITS;
+    size_t bucket = (shift + 1) * STATS_SUB_BUCKETS + ((value >> shift) & (STATS_SUB_BUCKETS - 1));
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+// The smallest value that ends up in the bucket
+static long bucket_start(size_t bucket) {
+    if (bucket < STATS_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = bucket / STATS_SUB_BUCKETS - 1;
+    return (long)(STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS) << shift;
+}
+
+void stats_count(int counter) {
+    COUNTERS[counter]++;
+}
+
+void stats_record(int histogram, long ns) {
+    struct histogram_t *target = &HISTOGRAMS[histogram];
+    target->count++;
+    target->total += ns;
+    if (ns > target->max) {
+        target->max = ns;
+    }
+
+    target->buckets[bucket_of(ns)]++;
+}
+
+long stats_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// Returns the value below which the given fraction of the recorded values
+// lie, being the end of the bucket holding it
+static long percentile(struct histogram_t *histogram, double fraction) {
+    size_t rank = histogram->count * fraction, seen = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > rank) {
+            // The last bucket has no end
+            return i + 1 < STATS_BUCKETS && bucket_start(i + 1) - 1 < histogram->max ? bucket_start(i + 1) - 1
+                                                                                     : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+static void print_histogram(FILE *out, const char *name, struct histogram_t *histogram, bool buckets) {
+    if (histogram->count == 0) {
+        fprintf(out, "%-16s %10d\n", name, 0);
+        return;
+    }
+
+    fprintf(out, "%-16s %10zu  mean %10.1f us  p50 %10.1f us  p90 %10.1f us  p99 %10.1f us  max %10.1f us\n", name,
+            histogram->count, histogram->total / 1e3 / histogram->count, percentile(histogram, 0.5) / 1e3,
+            percentile(histogram, 0.9) / 1e3, percentile(histogram, 0.99) / 1e3, histogram->max / 1e3);
+
+    if (!buckets) {
+        return;
+    }
+
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        if (histogram->buckets[i] > 0) {
+            fprintf(out, "  %14.3f us  %10zu\n", bucket_start(i) / 1e3, histogram->buckets[i]);
+        }
+    }
+}
+
+// Clearing a cache ("cache -c", "hash -r") also resets its counters, in
+// which case everything it counted is after the last reset
+static size_t since_reset(size_t value, size_t *base) {
+    if (value < *base) {
+        *base = 0;
+    }
+
+    return value - *base;
+}
+
+void stats_print(FILE *out, bool buckets) {
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        fprintf(out, "%-16s %10zu\n", COUNTER_NAMES[i], COUNTERS[i]);
+    }
+
+    struct plancache_stats_t plans;
+    struct pathcache_stats_t paths;
+    plancache_stats(&plans);
+    pathcache_stats(&paths);
+    fprintf(out, "%-16s %10zu\n%-16s %10zu\n", "parse cache hits", since_reset(plans.hits, &PLANCACHE_BASE.hits),
+            "parse cache miss", since_reset(plans.misses, &PLANCACHE_BASE.misses));
+    fprintf(out, "%-16s %10zu\n%-16s %10zu\n", "path cache hits", since_reset(paths.hits, &PATHCACHE_BASE.hits),
+            "path cache miss", since_reset(paths.misses, &PATHCACHE_BASE.misses));
+
+    for (int i = 0; i < STATS_HISTOGRAMS; i++) {
+        print_histogram(out, HISTOGRAM_NAMES[i], &HISTOGRAMS[i], buckets);
+    }
+}
+
+void stats_reset() {
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        COUNTERS[i] = 0;
+    }
+
+    for (int i = 0; i < STATS_HISTOGRAMS; i++) {
+        HISTOGRAMS[i] = (struct histogram_t){0};
+    }
+
+    plancache_stats(&PLANCACHE_BASE);
+    pathcache_stats(&PATHCACHE_BASE);
+}
@@ -0,0 +1,74 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Always-on counters and latency histograms of the shell itself, shown by the
+ * "stats" builtin. Recording is an increment, so this stays cheap on busy
+ * machines. Histograms have STATS_SUB_BUCKETS buckets per power of two, which
+ * bounds the error of any percentile to 1 / STATS_SUB_BUCKETS.
+ */
+
+// Counters
+#define STATS_COMMAND_LINES 0
+#define STATS_BUILTINS 1
+#define STATS_EXTERNAL 2
+#define STATS_COPIES 3
+#define STATS_FORKS 4
+#define STATS_SPAWNS 5
+#define STATS_LAUNCH_FAILURES 6
+#define STATS_BACKGROUND 7
+#define STATS_COUNTERS 8
+
+// Histograms, in nanoseconds
+#define STATS_PARSE 0
+#define STATS_LAUNCH 1
+#define STATS_FOREGROUND 2
+#define STATS_HISTOGRAMS 3
+
+#define STATS_SUB_BUCKET_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+// Values from 2^40 ns (about 18 minutes) up all end up in the last bucket
+#define STATS_MAX_BITS 40
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS)
+
+/**
+ * @brief Increment a counter
+ *
+ * @param counter One of the STATS_ counters, e.g. STATS_FORKS
+ */
+void stats_count(int counter);
+
+/**
+ * @brief Record a duration in a histogram
+ *
+ * @param histogram One of the STATS_ histograms, e.g. STATS_PARSE
+ * @param ns The duration in nanoseconds
+ */
+void stats_record(int histogram, long ns);
+
+/**
+ * @brief Get the current time of CLOCK_MONOTONIC
+ *
+ * @return long - The time in nanoseconds
+ */
+long stats_now();
+
+/**
+ * @brief Print every counter, the hits of the parse and path caches and a
+ * summary of every histogram
+ *
+ * @param out Where to print
+ * @param buckets If the non-empty buckets of every histogram are printed too
+ */
+void stats_print(FILE *out, bool buckets);
+
+/**
+ * @brief Reset every counter and histogram. The caches keep their entries,
+ * only their hits since the reset are shown.
+ */
+void stats_reset();
+
+#endif
@@ -4,65 +4,117 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static int add_token(struct command_tokens_t *tokens, char *ch, size_t len) {
-    if (len == 0) {
-        return 0;  // Nothing to add
-    }
+// Initial amount of token slots. The token array doubles in size every time
+// it runs full, so reading n tokens costs O(log n) allocations
+#define TOKENS_INITIAL_CAPACITY 16
+
+// Operator tokens are not stored in the input buffer, since the character
+// following a word that ends at an operator is overwritten by the NUL
+// terminator of that word. Instead they point to these strings. These
+// must never be modified.
+static char OPERATOR_TOKENS[][4] = {">", "<", "|", ">>", "<>", "|>", "<<", "<<<"};
+
+// Indices of the here-document and here-string operators above
+#define HEREDOC_TOKEN 6
+#define HERESTRING_TOKEN 7
+
+static int push_token(struct command_tokens_t *tokens, char *token) {
+    if (tokens->token_count == tokens->capacity) {
+        size_t capacity = tokens->capacity ? tokens->capacity * 2 : TOKENS_INITIAL_CAPACITY;
+        char **reallocated = arena_realloc(tokens->arena, tokens->tokens, sizeof(char *) * tokens->capacity,
+                                           sizeof(char *) * capacity);
+        if (reallocated == NULL) {
+            return 1;
+        }
 
-    char **reallocated = realloc(tokens->tokens, sizeof(char *) * (tokens->token_count + 1));
-    if (reallocated == NULL) {
-        return 1;
+        tokens->tokens = reallocated;
+        tokens->capacity = capacity;
     }
 
-    tokens->tokens = reallocated;
-    tokens->token_count++;
-    char *dest = malloc(len + 1);
-    if (dest == NULL) {
-        return 2;
+    tokens->tokens[tokens->token_count++] = token;
+    return 0;
+}
+
+// Adds the len characters starting at ch as a token. The token is terminated
+// in place, overwriting the character that follows it
+static int add_token(struct command_tokens_t *tokens, char *ch, size_t len) {
+    if (len == 0) {
+        return 0;  // Nothing to add
     }
 
-    tokens->tokens[tokens->token_count - 1] = dest;
-    memcpy(dest, ch, len);
-    *(dest + len) = '\0';
+    ch[len] = '\0';
+    return push_token(tokens, ch);
+}
 
-    return 0;
+static char *operator_token(char ch, bool doubled) {
+    size_t index = ch == '>' ? 0 : ch == '<' ? 1 : 2;
+    return OPERATOR_TOKENS[doubled ? index + 3 : index];
 }
 
-int tokens_read(struct command_tokens_t *tokens, char *input, size_t maxlen) {
-    // Duplicate the string to avoid modifying it
-    input = strdup(input);
+int tokens_read(struct command_tokens_t *tokens, char *input, size_t maxlen, struct arena_t *arena) {
+    size_t len = strnlen(input, maxlen);
+
+    // Duplicate the string to avoid modifying it. All tokens are slices of
+    // this single buffer
+    input = arena_strndup(arena, input, len);
     if (input == NULL) {
         return 1;
     }
 
-    size_t len = strlen(input);
-    if (len > maxlen) {
-        len = maxlen;
-    }
-
     tokens->token_count = 0;
+    tokens->capacity = 0;
     tokens->tokens = NULL;
+    tokens->arena = arena;
 
     bool escape = false;
     bool quotation = false;
+    bool doubled;
+    int heredoc;
     size_t start_index = 0;
 
     /*
     This method also supports quotation marks and escape character for spaces
     because it was fun to implement.
+
+    Escape characters are removed by compacting the buffer as we go. Characters
+    are read at index r and written back at index i, where i <= r. Token
+    boundaries are all expressed in terms of i, so every byte is only
+    touched once no matter how many escapes the line contains. Runs of
+    characters that need no special handling are found with scan_special.
     */
 
     char ch;
-    bool tmp;
-    for (size_t i = 0; i < len; i++) {
-        ch = input[i];
-        if (ch == '\\') {
+    size_t i = 0, run;
+    for (size_t r = 0; r < len; r++, i++) {
+        // Characters that are not special are simply part of the current
+        // token, so skip over them in bulk
+        run = scan_special(input + r, len - r);
+        if (run) {
+            if (i != r) {
+                memmove(input + i, input + r, run);
+            }
+
+            r += run;
+            i += run;
+            if (r == len) {
+                break;
+            }
+        }
+
+        ch = input[r];
+        if (CHAR_IS(ch, CLASS_ESCAPE)) {
             escape = true;
-            memmove(&input[i], &input[i + 1], len - i - 1);
-            ch = input[i];
-            len--;
+
+            // Drop the escape character and use the next one as is
+            if (++r == len) {
+                break;
+            }
+
+            ch = input[r];
         }
 
+        input[i] = ch;
+
         if (IS_WHITESPACE(ch)) {
             // We are within quotation marks
             if (quotation) {
@@ -76,7 +128,6 @@ int tokens_read(struct command_tokens_t *tokens, char *input, size_t maxlen) {
 
             if (add_token(tokens, input + start_index, i - start_index)) {
                 tokens_finish(tokens);
-                free(input);
                 return 1;
             }
 
@@ -90,32 +141,38 @@ int tokens_read(struct command_tokens_t *tokens, char *input, size_t maxlen) {
                 continue;
             }
 
-            // Complete previous token
-            if (start_index != i) {
-                if (add_token(tokens, input + start_index, i - start_index)) {
-                    tokens_finish(tokens);
-                    free(input);
-                    return 1;
-                }
+            // Allow ">>", and "<<" and "<<<" for here-documents and
+            // here-strings. Checked before the previous token is completed,
+            // since that overwrites the operator with a NUL terminator
+            doubled = (len - r) > 1 && input[r + 1] == '>';
+            heredoc = ch == '<' && (len - r) > 1 && input[r + 1] == '<'
+                          ? ((len - r) > 2 && input[r + 2] == '<' ? HERESTRING_TOKEN : HEREDOC_TOKEN)
+                          : 0;
 
-                start_index = i;
+            // Complete previous token
+            if (add_token(tokens, input + start_index, i - start_index)) {
+                tokens_finish(tokens);
+                return 1;
             }
 
-            // Allow ">>"
-            if ((len - i) > 1 && input[i + 1] == '>') {
+            if (heredoc) {
+                // Skip the remaining characters of the operator
+                r += heredoc - HEREDOC_TOKEN + 1;
+                i += heredoc - HEREDOC_TOKEN + 1;
+            } else if (doubled) {
+                r++;
                 i++;
             }
 
-            if (add_token(tokens, input + start_index, i - start_index + 1)) {
+            if (push_token(tokens, heredoc ? OPERATOR_TOKENS[heredoc] : operator_token(ch, doubled))) {
                 tokens_finish(tokens);
-                free(input);
                 return 1;
             }
 
             start_index = i + 1;
         }
 
-        if (ch == '"') {
+        if (CHAR_IS(ch, CLASS_QUOTE)) {
             quotation = !quotation;
 
             if (quotation) {
@@ -123,7 +180,6 @@ int tokens_read(struct command_tokens_t *tokens, char *input, size_t maxlen) {
             } else {
                 if (add_token(tokens, input + start_index, i - start_index)) {
                     tokens_finish(tokens);
-                    free(input);
                     return 1;
                 }
 
@@ -132,139 +188,20 @@ int tokens_read(struct command_tokens_t *tokens, char *input, size_t maxlen) {
         }
     }
 
-    if ((len - start_index) > 0 && add_token(tokens, input + start_index, len - start_index)) {
-        for (size_t i = 0; i < tokens->token_count; i++) {
-            free(tokens->tokens[i]);
-        }
+    // Length of the line after escape characters have been removed
+    len = i;
 
-        free(input);
-        free(tokens->tokens);
+    if ((len - start_index) > 0 && add_token(tokens, input + start_index, len - start_index)) {
+        tokens_finish(tokens);
         return 1;
     }
 
-    free(input);
     return 0;
 }
 
 void tokens_finish(struct command_tokens_t *token) {
-    for (size_t i = 0; i < token->token_count; i++) {
-        free(token->tokens[i]);
-    }
-
+    // Memory is owned by the arena, so there is nothing to free here
     token->token_count = 0;
-    free(token->tokens);
+    token->capacity = 0;
+    token->tokens = NULL;
 }
-
-size_t tokens_search(struct command_tokens_t *tokens, char *target) {
-    for (size_t i = 0; i < tokens->token_count; i++) {
-        if (!strcmp(tokens->tokens[i], target)) {
-            return i;
-        }
-    }
-
-    return -1;
-}
-
-int tokens_remove(struct command_tokens_t *tokens, size_t index_start, size_t index_end) {
-    if (index_end <= index_start) {
-        return 1;
-    }
-
-    if (index_end > tokens->token_count) {
-        return 2;
-    }
-
-    for (size_t i = index_start; i < index_end; i++) {
-        free(tokens->tokens[i]);
-    }
-
-    size_t to_remove = index_end - index_start;
-    // Amount of char * to the right of the data we need to remove
-    size_t copy_count = tokens->token_count - index_end;
-
-    // Move any data that comes after the section we remove so that it is not also removed
-    memmove(tokens->tokens + index_start, tokens->tokens + index_end, sizeof(char *) * copy_count);
-
-    tokens->token_count -= to_remove;
-    char **reallocated = realloc(tokens->tokens, sizeof(char *) * tokens->token_count);
-    if (reallocated == NULL) {
-        return 3;
-    }
-
-    tokens->tokens = reallocated;
-    return 0;
-}
-
-int tokens_split(char *token, struct command_tokens_t *input, size_t *count, struct command_tokens_t **output) {
-    // Not the most beautiful thing I've ever written, but it does at least work
-    size_t previous_split = 0;
-    *count = 1;  // We will always have 1 part, and then 1 extra for each split we encounter
-
-    // First determine the count. We could use realloc and modify everything as
-    // we go but that approach ended up being a mess of memory manipulation
-    for (size_t i = 0; i < input->token_count; i++) {
-        // Check if token is equal
-        if (strcmp(input->tokens[i], token)) {
-            continue;
-        }
-
-        (*count)++;
-    }
-
-    *output = malloc(sizeof(struct command_tokens_t) * (*count));
-    if ((*output) == NULL) {
-        return 1;
-    }
-
-    size_t part_index = 0;
-    struct command_tokens_t *current;
-    for (size_t i = 0; i < input->token_count; i++) {
-        // Check if token is equal
-        if (strcmp(input->tokens[i], token)) {
-            continue;
-        }
-
-        free(input->tokens[i]);  // This token will no longer be used
-
-        current = &(*output)[part_index++];
-        if (current == NULL) {
-            free(*output);
-            return 1;
-        }
-
-        current->token_count = i - previous_split;
-        current->tokens = malloc(sizeof(char *) * current->token_count);
-        if (current->tokens == NULL) {
-            free(*output);
-            return 1;
-        }
-
-        // Copy pointers to tokens to the new part
-        memcpy(current->tokens, input->tokens + previous_split, sizeof(char *) * current->token_count);
-        previous_split = i + 1;
-    }
-
-    // Add the remaining characters. Even if this count is 0, we should add another part,
-    // since there should technically occur a split (e. g. "test |" with split on "|" should
-    // have 2 parts)
-    current = &(*output)[part_index++];
-    if (current == NULL) {
-        free(*output);
-        return 1;
-    }
-
-    current->token_count = input->token_count - previous_split;
-    current->tokens = malloc(sizeof(char *) * current->token_count);
-    if (current->tokens == NULL) {
-        free(*output);
-        return 1;
-    }
-
-    // Copy pointers to tokens to the new part
-    memcpy(current->tokens, input->tokens + previous_split, sizeof(char *) * current->token_count);
-
-    // Free the previous tokens struct
-    input->token_count = 0;
-    free(input->tokens);
-    return 0;
-}
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Details longer than this are cut off
+#define TRACE_DETAIL_LENGTH 256
+// Upper bound of a single event, with every character of the detail escaped
+#define TRACE_EVENT_SIZE (TRACE_DETAIL_LENGTH * 6 + 256)
+
+bool trace_enabled = false;
+
+static int TRACE_FD = -1;
+static char *TRACE_PATH = NULL;
+// The shell that started recording, which every track belongs to
+static pid_t TRACE_PID = 0;
+// The process recording events, which is a forked child after fork()
+static pid_t CURRENT_PID = 0;
+static bool EXIT_REGISTERED = false;
+
+static char BUFFER[TRACE_BUFFER_SIZE];
+static size_t BUFFER_USED = 0;
+
+static void flush_buffer() {
+    ssize_t res;
+    for (size_t written = 0; written < BUFFER_USED; written += res) {
+        res = write(TRACE_FD, BUFFER + written, BUFFER_USED - written);
+        if (res < 0) {
+            if (errno == EINTR) {
+                res = 0;
+                continue;
+            }
+
+            // Nothing sensible to do, the trace is simply incomplete
+            break;
+        }
+    }
+
+    BUFFER_USED = 0;
+}
+
+// Writes the string as the contents of a JSON string into dst, which must
+// have room for TRACE_DETAIL_LENGTH escaped characters
+static void escape(char *dst, const char *str) {
+    unsigned char ch;
+    for (size_t i = 0; str[i] != '\0' && i < TRACE_DETAIL_LENGTH; i++) {
+        ch = str[i];
+        if (ch == '"' || ch == '\\') {
+            *dst++ = '\\';
+            *dst++ = ch;
+        } else if (ch < 0x20) {
+            dst += sprintf(dst, "\\u%04x", ch);
+        } else {
+            *dst++ = ch;
+        }
+    }
+
+    *dst = '\0';
+}
+
+// Appends a single event to the buffer. The file starts with a metadata
+// event, so every following event starts with a comma. The closing bracket
+// is optional in the format, which keeps the file usable if the shell dies
+static void append(const char *name, char phase, long start, long end, pid_t pid, const char *key,
+                   const char *value) {
+    char escaped[TRACE_DETAIL_LENGTH * 6 + 1];
+
+    if (BUFFER_USED + TRACE_EVENT_SIZE > TRACE_BUFFER_SIZE) {
+        flush_buffer();
+    }
+
+    // Timestamps are in microseconds
+    BUFFER_USED += snprintf(BUFFER + BUFFER_USED, TRACE_BUFFER_SIZE - BUFFER_USED, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%ld.%03ld,\"pid\":%d,\"tid\":%d",
+                            name, phase, start / 1000, start % 1000, TRACE_PID, pid != 0 ? pid : CURRENT_PID);
+
+    if (phase == 'X') {
+        BUFFER_USED += snprintf(BUFFER + BUFFER_USED, TRACE_BUFFER_SIZE - BUFFER_USED,
+                                ",\"dur\":%ld.%03ld", (end - start) / 1000, (end - start) % 1000);
+    } else if (phase == 'i') {
+        BUFFER_USED += snprintf(BUFFER + BUFFER_USED, TRACE_BUFFER_SIZE - BUFFER_USED, ",\"s\":\"t\"");
+    }
+
+    if (value != NULL) {
+        escape(escaped, value);
+        BUFFER_USED += snprintf(BUFFER + BUFFER_USED, TRACE_BUFFER_SIZE - BUFFER_USED,
+                                ",\"args\":{\"%s\":\"%s\"}", key, escaped);
+    }
+
+    BUFFER_USED += snprintf(BUFFER + BUFFER_USED, TRACE_BUFFER_SIZE - BUFFER_USED, "}");
+}
+
+// A forked child has a copy of the events buffered by the shell, which must
+// not be written a second time
+static void check_forked() {
+    pid_t pid = getpid();
+    if (pid != CURRENT_PID) {
+        CURRENT_PID = pid;
+        BUFFER_USED = 0;
+    }
+}
+
+int trace_start(const char *path) {
+    trace_stop();
+
+    // Appending keeps events written by forked children from overwriting
+    // each other
+    TRACE_FD = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (TRACE_FD == -1) {
+        return 1;
+    }
+
+    TRACE_PATH = strdup(path);
+    if (TRACE_PATH == NULL) {
+        close(TRACE_FD);
+        TRACE_FD = -1;
+        return 1;
+    }
+
+    // The trace is completed when the shell exits, e.g. through "exit"
+    if (!EXIT_REGISTERED) {
+        atexit(trace_stop);
+        EXIT_REGISTERED = true;
+    }
+
+    TRACE_PID = CURRENT_PID = getpid();
+    BUFFER_USED = snprintf(BUFFER, TRACE_BUFFER_SIZE,
+                           "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                           "\"args\":{\"name\":\"flush\"}}",
+                           TRACE_PID, TRACE_PID);
+    // Forked children write directly, which must come after the header
+    flush_buffer();
+    trace_enabled = true;
+    return 0;
+}
+
+void trace_stop() {
+    if (!trace_enabled) {
+        return;
+    }
+
+    // A forked child exiting without exec only writes what it recorded itself
+    if (getpid() != TRACE_PID) {
+        check_forked();
+        flush_buffer();
+        return;
+    }
+
+    BUFFER_USED += snprintf(BUFFER + BUFFER_USED, TRACE_BUFFER_SIZE - BUFFER_USED, "\n]\n");
+    flush_buffer();
+    close(TRACE_FD);
+    free(TRACE_PATH);
+    TRACE_FD = -1;
+    TRACE_PATH = NULL;
+    trace_enabled = false;
+}
+
+const char *trace_path() {
+    return TRACE_PATH;
+}
+
+long trace_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return trace_time(&now);
+}
+
+long trace_time(const struct timespec *time) {
+    return time->tv_sec * 1000000000L + time->tv_nsec;
+}
+
+void trace_event(const char *name, long start, long end, pid_t pid, const char *detail) {
+    check_forked();
+    append(name, 'X', start, end, pid, "detail", detail);
+}
+
+void trace_process(pid_t pid, const char *name) {
+    check_forked();
+    append("thread_name", 'M', 0, 0, pid, "name", name);
+}
+
+void trace_exec(const char *executable) {
+    check_forked();
+    append("exec", 'i', trace_now(), 0, 0, "executable", executable);
+    flush_buffer();
+}
@@ -0,0 +1,104 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Timestamps the phases of every command line, from reading the input to the
+ * exit of every part, and writes them as Chrome trace_event JSON that can be
+ * opened in Perfetto or chrome://tracing. Enabled with FLUSH_TRACE=file or
+ * the "trace" builtin. While disabled, every trace point is a single branch.
+ *
+ * Phases of the shell itself are recorded on the thread track of the shell.
+ * Every started process gets its own track, named after its executable, with
+ * the launch (fork or posix_spawn), the exec for forked children and the time
+ * until it was reaped.
+ */
+
+// Events are collected in a buffer of this size, and written out when full
+#define TRACE_BUFFER_SIZE 65536
+
+// Set while a trace is being recorded
+extern bool trace_enabled;
+
+/**
+ * @brief Start recording a trace into the given file, which is truncated. A
+ * trace that is already being recorded is stopped first.
+ *
+ * @param path The path of the file
+ * @return int - 0 if success, non-zero otherwise
+ */
+int trace_start(const char *path);
+
+/**
+ * @brief Stop recording, writing out the buffered events and completing the
+ * file. Does nothing when not recording, or when called in a child.
+ */
+void trace_stop();
+
+/**
+ * @brief Get the path of the trace being recorded
+ *
+ * @return const char* - The path, or NULL when not recording
+ */
+const char *trace_path();
+
+/**
+ * @brief Get the current time of CLOCK_MONOTONIC
+ *
+ * @return long - The time in nanoseconds
+ */
+long trace_now();
+
+/**
+ * @brief Convert a time of CLOCK_MONOTONIC to nanoseconds
+ *
+ * @param time The time
+ * @return long - The time in nanoseconds
+ */
+long trace_time(const struct timespec *time);
+
+/**
+ * @brief Record a phase that has completed
+ *
+ * @param name The name of the phase
+ * @param start The start time in nanoseconds
+ * @param end The end time in nanoseconds
+ * @param pid The process the phase belongs to, or 0 for the shell itself
+ * @param detail Shown as the argument of the event, e.g. the command line.
+ * May be NULL
+ */
+void trace_event(const char *name, long start, long end, pid_t pid, const char *detail);
+
+/**
+ * @brief Name the track of a started process
+ *
+ * @param pid The process
+ * @param name The name, e.g. the executable
+ */
+void trace_process(pid_t pid, const char *name);
+
+/**
+ * @brief Record the exec of a forked child. Meant to be called in the child
+ * right before exec, so the event is written directly instead of buffered.
+ *
+ * @param executable The executable about to be exec'd
+ */
+void trace_exec(const char *executable);
+
+// Returns the start time of a phase, or 0 when not recording
+static inline long trace_begin() {
+    return trace_enabled ? trace_now() : 0;
+}
+
+// Records a phase of the shell started with trace_begin. Phases started
+// before recording was enabled are left out
+static inline void trace_end(const char *name, long start, const char *detail) {
+    if (trace_enabled && start != 0) {
+        trace_event(name, start, trace_now(), 0, detail);
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Runs "parallel" at the end of a pipeline through the shell binary, and
+ * checks that the exits of the parts feeding it are not lost while it waits
+ * for its items. Items that start no process, because they fail to launch or
+ * are builtins, once made the shell drop those exits.
+ *
+ * Usage: test_parallel [flush binary], by default ./flush
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTPUT_SIZE 65536
+
+struct test_case_t {
+    const char *name;
+    const char *script;
+    // Output that must be present, and output that must not be
+    const char *expected;
+    const char *unexpected;
+};
+
+static const struct test_case_t CASES[] = {
+    {
+        "failing item",
+        "sh -c \"echo nosuch_zz; echo sleep; sleep 0.1; exit 3\" | parallel -j 2 \"{} 0.5\"",
+        "parallel: 2 items, 1 failed",
+        "Error while waiting",
+    },
+    {
+        "builtin item",
+        "set -o pipefail\n"
+        "sh -c \"echo sleep; echo true; sleep 0.1; exit 3\" | parallel -j 2 \"{} 0.5\"",
+        "Exit status [sh -c \"echo sleep; echo true; sleep 0.1; exit 3\" | parallel -j 2 \"{} 0.5\"] = 3",
+        "Error while waiting",
+    },
+};
+
+#define CASE_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+// Runs the script with "flush -c" and returns everything it printed
+static char *run_script(const char *shell, const char *script) {
+    static char output[OUTPUT_SIZE];
+    char command[4096];
+    FILE *file;
+
+    // The script is passed through the environment, so it needs no quoting
+    setenv("TEST_SCRIPT", script, 1);
+    snprintf(command, sizeof(command), "%s -c \"$TEST_SCRIPT\" 2>&1", shell);
+    if ((file = popen(command, "r")) == NULL) {
+        perror("popen");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t length = fread(output, 1, sizeof(output) - 1, file);
+    output[length] = '\0';
+    pclose(file);
+    return output;
+}
+
+int main(int argc, char **argv) {
+    const char *shell = argc > 1 ? argv[1] : "./flush";
+    size_t failures = 0;
+
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        char *output = run_script(shell, CASES[i].script);
+        if (strstr(output, CASES[i].expected) == NULL || strstr(output, CASES[i].unexpected) != NULL) {
+            fprintf(stderr, "FAIL %s, output:\n%s", CASES[i].name, output);
+            failures++;
+        }
+    }
+
+    printf("test_parallel: %zu/%zu passed\n", CASE_COUNT - failures, CASE_COUNT);
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+/*
+ * Pins the semantics of tokens_read: escapes, quotes and the splitting of
+ * the I/O redirect and pipe operators. Every line is tokenized with each
+ * scanner implementation supported by the CPU, and once more after padding
+ * that moves the interesting part across the 16 and 32 byte blocks the SIMD
+ * scanners work on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+#define MAX_TOKENS 16
+// Padding in front of every line, see check_padded()
+#define PAD_LENGTH 37
+
+struct test_case_t {
+    const char *line;
+    const char *tokens[MAX_TOKENS];
+};
+
+// Expected tokens, terminated by NULL
+static const struct test_case_t CASES[] = {
+    // Whitespace
+    {"", {NULL}},
+    {"   \t ", {NULL}},
+    {"ls -l", {"ls", "-l", NULL}},
+    {"  a \t b  ", {"a", "b", NULL}},
+
+    // Backslash escapes the next character, and is dropped itself
+    {"echo a\\ b", {"echo", "a b", NULL}},
+    {"a\\\\b", {"a\\b", NULL}},
+    {"echo \\\"x\\\"", {"echo", "x", NULL}},
+    {"a\\>b", {"a", ">", "b", NULL}},
+    {"a\\|b", {"a", "|", "b", NULL}},
+    {"a\\", {"a", NULL}},
+    {"\\ \\ ", {"  ", NULL}},
+
+    // Double quotes keep whitespace and operators in a single token
+    {"echo \"a b\" c", {"echo", "a b", "c", NULL}},
+    {"\"a|b > c\"", {"a|b > c", NULL}},
+    {"echo \"a\\\\b\"", {"echo", "a\\b", NULL}},
+    {"echo \"a\\\"b\"", {"echo", "a", NULL}},
+    {"x\"\"y", {"y", NULL}},
+    {"\"unterminated", {"unterminated", NULL}},
+    {"echo 'a b'", {"echo", "'a", "b'", NULL}},
+
+    // Operators are split off, with or without surrounding whitespace
+    {"a>b", {"a", ">", "b", NULL}},
+    {"a > b", {"a", ">", "b", NULL}},
+    {"a>>b", {"a", ">>", "b", NULL}},
+    {"a >> b", {"a", ">>", "b", NULL}},
+    {"a>>>b", {"a", ">>", ">", "b", NULL}},
+    {"a<b", {"a", "<", "b", NULL}},
+    {"a<>b", {"a", "<>", "b", NULL}},
+    {"a|b", {"a", "|", "b", NULL}},
+    {"a | b | c", {"a", "|", "b", "|", "c", NULL}},
+    {"a|>b", {"a", "|>", "b", NULL}},
+    {"a<b|c>d", {"a", "<", "b", "|", "c", ">", "d", NULL}},
+    {"a >", {"a", ">", NULL}},
+
+    // Here-documents and here-strings
+    {"cat <<EOF", {"cat", "<<", "EOF", NULL}},
+    {"cat << EOF", {"cat", "<<", "EOF", NULL}},
+    {"cat <<<word", {"cat", "<<<", "word", NULL}},
+    {"cat <<< \"a b\"", {"cat", "<<<", "a b", NULL}},
+};
+
+#define CASE_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+static int check_line(const struct test_case_t *test, const char *line, int implementation) {
+    size_t length = strlen(line);
+    // tokens_read copies the input, so pass a copy that it could not get
+    // away with modifying
+    char *input = malloc(length + 1);
+    struct arena_t *arena = arena_create();
+    if (input == NULL || arena == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(input, line, length + 1);
+
+    struct command_tokens_t tokens = {0};
+    int failed = tokens_read(&tokens, input, length, arena) != 0 || strcmp(input, line) != 0;
+
+    size_t expected = 0;
+    while (test->tokens[expected] != NULL) {
+        expected++;
+    }
+
+    failed |= !failed && tokens.token_count != expected;
+    for (size_t i = 0; !failed && i < expected; i++) {
+        failed = strcmp(tokens.tokens[i], test->tokens[i]) != 0;
+    }
+
+    if (failed) {
+        fprintf(stderr, "FAIL [%s] with scanner %d\n", line, implementation);
+        for (size_t i = 0; i < expected; i++) {
+            fprintf(stderr, " expected[%zu] = \"%s\"\n", i, test->tokens[i]);
+        }
+
+        for (size_t i = 0; i < tokens.token_count; i++) {
+            fprintf(stderr, " actual[%zu] = \"%s\"\n", i, tokens.tokens[i]);
+        }
+    }
+
+    arena_free(arena);
+    free(input);
+    return failed;
+}
+
+// Prefixes the line with a long first token, which is checked as well
+static int check_padded(const struct test_case_t *test, int implementation) {
+    static const char PAD[PAD_LENGTH + 1] = "ppppppppppppppppppppppppppppppppppppp";
+    char line[256];
+    struct test_case_t padded = {line, {PAD}};
+
+    snprintf(line, sizeof(line), "%s %s", PAD, test->line);
+    for (size_t i = 0; i + 1 < MAX_TOKENS && test->tokens[i] != NULL; i++) {
+        padded.tokens[i + 1] = test->tokens[i];
+    }
+
+    return check_line(&padded, line, implementation);
+}
+
+int main() {
+    size_t failures = 0, runs = 0;
+    int previous = scan_selected();
+
+    for (int implementation = SCAN_SCALAR; implementation <= SCAN_AVX2; implementation++) {
+        if (scan_select(implementation)) {
+            continue;  // Not supported on this CPU
+        }
+
+        for (size_t i = 0; i < CASE_COUNT; i++) {
+            failures += check_line(&CASES[i], CASES[i].line, implementation);
+            failures += check_padded(&CASES[i], implementation);
+            runs += 2;
+        }
+    }
+
+    scan_select(previous);
+    printf("test_tokens: %zu/%zu passed\n", runs - failures, runs);
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}